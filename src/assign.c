@@ -43,6 +43,7 @@
 #include "statement.h"
 #include "assign.h"
 #include "fileio.h"
+#include "iostate.h"
 #include "mos.h"
 
 #ifdef DEBUG
@@ -132,7 +133,12 @@ static void assign_stringdol(pointers address) {
     free_string(*lhstring);
     *lhstring = result;
   }
-  else if (lhstring->stringaddr!=result.stringaddr) {	/* Not got something like 'a$=a$' */
+  else if (result.stringlen==1) {	/* Single character strings are not put on the heap */
+    result = char_string(*result.stringaddr);
+    free_string(*lhstring);
+    *lhstring = result;
+  }
+  else if (lhstring->stringaddr!=result.stringaddr || lhstring->stringlen!=result.stringlen) {	/* Not got something like 'a$=a$' */
     cp = alloc_string(result.stringlen);	/* Have to make copy of string */
     memmove(cp, result.stringaddr, result.stringlen);
     free_string(*lhstring);
@@ -141,6 +147,37 @@ static void assign_stringdol(pointers address) {
   }
 }
 
+/*
+** 'share_stringvar' deals with the common assignment 'a$=b$' where
+** the right-hand side is nothing but another string variable. Rather
+** than copy the string, the two variables share it until one of them
+** is changed. It returns TRUE if it handled the assignment or FALSE
+** if the expression has to be evaluated in the normal way
+*/
+static boolean share_stringvar(basicstring *lhstring) {
+  basicstring *rhstring, value;
+  if (*basicvars.current!=BASIC_TOKEN_STRINGVAR || !ateol[basicvars.current[LOFFSIZE+1]]) return FALSE;
+  rhstring = GET_ADDRESS(basicvars.current, basicstring *);
+  basicvars.current+=LOFFSIZE+1;
+  if (lhstring->stringaddr!=rhstring->stringaddr || lhstring->stringlen!=rhstring->stringlen) {	/* Not got something like 'a$=a$' */
+    value = share_string(*rhstring);
+    free_string(*lhstring);
+    *lhstring = value;
+  }
+  return TRUE;
+}
+
+/*
+** 'own_stringvar' is called before a string variable is altered in
+** place. If the variable shares its string with other variables it is
+** given its own copy of it. The function returns the variable's
+** string descriptor
+*/
+static basicstring own_stringvar(basicstring *sp) {
+  if (sp->stringlen>0) sp->stringaddr = resize_string(sp->stringaddr, sp->stringlen, sp->stringlen);
+  return *sp;
+}
+
 /*
 ** 'assign_intbyteptr' deals with assignments to byte-sized indirect
 ** integer variables
@@ -673,11 +710,9 @@ static void assign_strarray(pointers address) {
       if (!check_arrays(ap, ap2)) error(ERR_TYPEARRAY);
       p = ap->arraystart.stringbase;
       p2 = ap2->arraystart.stringbase;
-      for (n=0; n<ap->arrsize; n++) {	/* Duplicate entire array */
+      for (n=0; n<ap->arrsize; n++) {	/* Duplicate entire array, sharing the strings */
         free_string(*p);
-        p->stringlen = p2->stringlen;
-        p->stringaddr = alloc_string(p2->stringlen);
-        memmove(p->stringaddr, p2->stringaddr, p2->stringlen);
+        *p = share_string(*p2);
         p++;
         p2++;
       }
@@ -760,6 +795,11 @@ static void assiplus_stringdol(pointers address) {
     lhstring = address.straddr;
     newlen = lhstring->stringlen+extralen;
     if (newlen>MAXSTRING) error(ERR_STRINGLEN);
+    if (exprtype==STACK_STRING && result.stringaddr>=lhstring->stringaddr
+     && result.stringaddr<lhstring->stringaddr+lhstring->stringlen) {	/* Appending part of the string to itself */
+      memmove(basicvars.stringwork, result.stringaddr, extralen);
+      result.stringaddr = basicvars.stringwork;
+    }
     cp = resize_string(lhstring->stringaddr, lhstring->stringlen, newlen);
     memmove(cp+lhstring->stringlen, result.stringaddr, extralen);
     lhstring->stringlen = newlen;
@@ -2196,6 +2236,346 @@ static void (*assidiv_table[])(pointers) = {
   assignment_invalid, assibit_badtype, assignment_invalid, assignment_invalid
 };
 
+/*
+** Whole array expressions such as 'r()=a()*b()+c()*d()' are normally
+** evaluated one operator at a time, each step creating a temporary array
+** on the Basic stack that is then copied into the destination. The
+** following functions deal with the common case where a floating point
+** array is assigned an expression made up of '+', '-', '*' and '/'
+** applied to floating point arrays of the same shape as the destination,
+** simple numeric variables and numeric constants, and the functions ABS,
+** COS, EXP, INT, LN, SIN and SQR applied to array operands. The expression is
+** turned into a short postfix program and then evaluated element by
+** element in blocks of FUSEBLOCK entries, writing the results straight
+** into the destination. Anything else is left to 'expression'.
+** Errors such as division by zero have to be reported before the
+** destination is changed. Divisors and arguments of LN and SQR that
+** are plain arrays or values are checked while the program is built.
+** If one is an array expression instead, the program is first run
+** without storing the results to find any error
+*/
+#define FUSEBLOCK 256		/* Number of array elements evaluated at a time */
+#define FUSEMAXITEMS 32		/* Maximum number of operands and operators */
+#define FUSEMAXDEPTH 8		/* Maximum depth of the operand stack */
+
+#define FUSEFUNCTION 1		/* 'Operator' used for a function applied to an array */
+
+typedef struct {
+  byte operator;		/* Operator or 0 if this is an operand */
+  byte function;		/* Function token if operator is FUSEFUNCTION */
+  float64 *vector;		/* Array operand or NIL for a scalar */
+  float64 scalar;		/* Value of scalar operand */
+} fuseitem;
+
+typedef struct {
+  basicarray *shape;		/* Destination array */
+  int32 count, depth, maxdepth;
+  boolean mustcheck;		/* TRUE if program has to be run to check for errors first */
+  fuseitem items[FUSEMAXITEMS];
+} fuseprog;
+
+static float64 fusebuffer[FUSEMAXDEPTH][FUSEBLOCK];
+static float64 fusescratch[FUSEBLOCK];	/* Results when running the program as a check */
+
+static boolean fuse_expression(fuseprog *, boolean *);
+static boolean fuse_factor(fuseprog *, boolean *);
+
+/*
+** 'fuse_leaf' returns TRUE if the token at 'tp' is a reference to an entire
+** array, a simple variable or a numeric constant. These can be evaluated
+** by 'factor' without side effects so it does not matter if they end up
+** being evaluated a second time by 'expression'
+*/
+static boolean fuse_leaf(byte *tp) {
+  byte *base, *np;
+  switch (*tp) {
+  case BASIC_TOKEN_ARRAYVAR: case BASIC_TOKEN_STATICVAR: case BASIC_TOKEN_INTVAR:
+  case BASIC_TOKEN_INT64VAR: case BASIC_TOKEN_FLOATVAR: case BASIC_TOKEN_INTZERO:
+  case BASIC_TOKEN_INTONE: case BASIC_TOKEN_SMALLINT: case BASIC_TOKEN_INTCON:
+  case BASIC_TOKEN_INT64CON: case BASIC_TOKEN_FLOATZERO: case BASIC_TOKEN_FLOATONE:
+  case BASIC_TOKEN_FLOATCON:
+    return TRUE;
+  case BASIC_TOKEN_XVAR:	/* Not seen yet - Only accept arrays and plain variables */
+    base = get_srcaddr(tp);
+    np = skip_name(base);
+    tp+=LOFFSIZE+1;
+    if (*(np-1) == '(' || *(np-1) == '[') return *tp == ')';
+    return *tp != '?' && *tp != '!';
+  default:
+    return FALSE;
+  }
+}
+
+/*
+** 'fuse_checkdomain' reports an error if 'function' cannot be applied to
+** one of the 'count' values at 'vp'. The error is the same one that
+** the function gives for a single value
+*/
+static void fuse_checkdomain(byte function, float64 *vp, int32 count) {
+  int32 n;
+  if (function == BASIC_TOKEN_SQR) {
+    for (n = 0; n < count; n++) {
+      if (vp[n] < 0.0) error(ERR_NEGROOT);
+    }
+  } else if (function == BASIC_TOKEN_LN) {
+    for (n = 0; n < count; n++) {
+      if (vp[n] <= 0.0) error(ERR_LOGRANGE);
+    }
+  }
+}
+
+/*
+** 'fuse_function' adds the function at 'basicvars.current' and its
+** argument to the program. Only functions of an array are dealt with.
+** As with division, the argument is checked here if it is a plain array
+** otherwise the program is marked as needing a checking run
+*/
+static boolean fuse_function(fuseprog *prog, boolean *isvector) {
+  fuseitem *ip;
+  byte function;
+  function = *(basicvars.current+1);
+  if (function != BASIC_TOKEN_ABS && function != BASIC_TOKEN_COS && function != BASIC_TOKEN_EXP
+   && function != BASIC_TOKEN_INT && function != BASIC_TOKEN_LN && function != BASIC_TOKEN_SIN
+   && function != BASIC_TOKEN_SQR) return FALSE;
+  basicvars.current+=2;
+  if (!fuse_factor(prog, isvector) || !*isvector || prog->count == FUSEMAXITEMS) return FALSE;
+  ip = &prog->items[prog->count-1];
+  if (function == BASIC_TOKEN_LN || function == BASIC_TOKEN_SQR) {
+    if (ip->operator == 0)
+      fuse_checkdomain(function, ip->vector, prog->shape->arrsize);
+    else {
+      prog->mustcheck = TRUE;
+    }
+  }
+  ip = &prog->items[prog->count];
+  ip->operator = FUSEFUNCTION;
+  ip->function = function;
+  prog->count++;
+  return TRUE;
+}
+
+/*
+** 'fuse_factor' adds an operand to the program. It returns FALSE if
+** the operand is not one that can be dealt with
+*/
+static boolean fuse_factor(fuseprog *prog, boolean *isvector) {
+  fuseitem *ip;
+  basicarray *ap;
+  if (*basicvars.current == TYPE_FUNCTION) return fuse_function(prog, isvector);
+  if (*basicvars.current == '(') {
+    basicvars.current++;
+    if (!fuse_expression(prog, isvector) || *basicvars.current != ')') return FALSE;
+    basicvars.current++;
+    return TRUE;
+  }
+  if (!fuse_leaf(basicvars.current) || prog->count == FUSEMAXITEMS) return FALSE;
+  factor();
+  ip = &prog->items[prog->count];
+  ip->operator = 0;
+  ip->vector = NIL;
+  switch (GET_TOPITEM) {
+  case STACK_INT:	ip->scalar = TOFLOAT(pop_int()); break;
+  case STACK_INT64:	ip->scalar = TOFLOAT(pop_int64()); break;
+  case STACK_FLOAT:	ip->scalar = pop_float(); break;
+  case STACK_FLOATARRAY:
+    ap = pop_array();
+    if (!check_arrays(prog->shape, ap)) return FALSE;
+    ip->vector = ap->arraystart.floatbase;
+    break;
+  case STACK_INTARRAY: case STACK_INT64ARRAY:
+    pop_array();
+    return FALSE;
+  default:
+    return FALSE;
+  }
+  prog->count++;
+  prog->depth++;
+  if (prog->depth > prog->maxdepth) prog->maxdepth = prog->depth;
+  *isvector = ip->vector != NIL;
+  return TRUE;
+}
+
+/*
+** 'fuse_operator' adds the binary operator 'operator' to the program.
+** At least one of its operands has to be an array. Division by zero is
+** reported here if possible, before the destination has been touched,
+** as that is where 'expression' would have found it. An array expression
+** as the divisor means the program needs a checking run
+*/
+static boolean fuse_operator(fuseprog *prog, byte operator, boolean lhvector, boolean rhvector) {
+  fuseitem *rp;
+  int32 n;
+  if (!lhvector && !rhvector) return FALSE;
+  if (prog->count == FUSEMAXITEMS) return FALSE;
+  rp = &prog->items[prog->count-1];
+  if (operator == '/' && rp->operator != 0) prog->mustcheck = TRUE;
+  if (operator == '/' && rp->operator == 0) {
+    if (rp->vector == NIL) {
+      if (rp->scalar == 0.0) error(ERR_DIVZERO);
+    } else {
+      for (n = 0; n < prog->shape->arrsize; n++) {
+        if (rp->vector[n] == 0.0) error(ERR_DIVZERO);
+      }
+    }
+  }
+  prog->items[prog->count].operator = operator;
+  prog->count++;
+  prog->depth--;
+  return TRUE;
+}
+
+/*
+** 'fuse_term' deals with multiplication and division
+*/
+static boolean fuse_term(fuseprog *prog, boolean *isvector) {
+  byte operator;
+  boolean rhvector;
+  if (!fuse_factor(prog, isvector)) return FALSE;
+  while (*basicvars.current == '*' || *basicvars.current == '/') {
+    operator = *basicvars.current;
+    basicvars.current++;
+    if (!fuse_factor(prog, &rhvector) || !fuse_operator(prog, operator, *isvector, rhvector)) return FALSE;
+    *isvector = TRUE;
+  }
+  return TRUE;
+}
+
+/*
+** 'fuse_expression' deals with addition and subtraction
+*/
+static boolean fuse_expression(fuseprog *prog, boolean *isvector) {
+  byte operator;
+  boolean rhvector;
+  if (!fuse_term(prog, isvector)) return FALSE;
+  while (*basicvars.current == '+' || *basicvars.current == '-') {
+    operator = *basicvars.current;
+    basicvars.current++;
+    if (!fuse_term(prog, &rhvector) || !fuse_operator(prog, operator, *isvector, rhvector)) return FALSE;
+    *isvector = TRUE;
+  }
+  return TRUE;
+}
+
+/*
+** 'fuse_block' applies one operator to 'count' elements, storing the
+** results at 'result'. Either operand can be a scalar but not both.
+** 'result' is allowed to be the same as one of the operands
+*/
+static void fuse_block(byte operator, float64 *result, fuseitem *lh, fuseitem *rh, int32 count) {
+  float64 *lp = lh->vector, *rp = rh->vector, value;
+  int32 n;
+  if (lp != NIL && rp != NIL) {
+    switch (operator) {
+    case '+': for (n = 0; n < count; n++) result[n] = lp[n]+rp[n]; break;
+    case '-': for (n = 0; n < count; n++) result[n] = lp[n]-rp[n]; break;
+    case '*': for (n = 0; n < count; n++) result[n] = lp[n]*rp[n]; break;
+    default:
+      for (n = 0; n < count; n++) {
+        if (rp[n] == 0.0) error(ERR_DIVZERO);
+        result[n] = lp[n]/rp[n];
+      }
+    }
+  } else if (lp != NIL) {	/* <array> <op> <value> */
+    value = rh->scalar;
+    switch (operator) {
+    case '+': for (n = 0; n < count; n++) result[n] = lp[n]+value; break;
+    case '-': for (n = 0; n < count; n++) result[n] = lp[n]-value; break;
+    case '*': for (n = 0; n < count; n++) result[n] = lp[n]*value; break;
+    default:  for (n = 0; n < count; n++) result[n] = lp[n]/value;
+    }
+  } else {	/* <value> <op> <array> */
+    value = lh->scalar;
+    switch (operator) {
+    case '+': for (n = 0; n < count; n++) result[n] = value+rp[n]; break;
+    case '-': for (n = 0; n < count; n++) result[n] = value-rp[n]; break;
+    case '*': for (n = 0; n < count; n++) result[n] = value*rp[n]; break;
+    default:
+      for (n = 0; n < count; n++) {
+        if (rp[n] == 0.0) error(ERR_DIVZERO);
+        result[n] = value/rp[n];
+      }
+    }
+  }
+}
+
+/*
+** 'fuse_apply' applies 'function' to the 'count' values at 'vp',
+** storing the results at 'result'
+*/
+static void fuse_apply(byte function, float64 *result, float64 *vp, int32 count) {
+  int32 n;
+  fuse_checkdomain(function, vp, count);
+  switch (function) {
+  case BASIC_TOKEN_ABS: for (n = 0; n < count; n++) result[n] = fabs(vp[n]); break;
+  case BASIC_TOKEN_COS: for (n = 0; n < count; n++) result[n] = cos(vp[n]); break;
+  case BASIC_TOKEN_EXP: for (n = 0; n < count; n++) result[n] = exp(vp[n]); break;
+  case BASIC_TOKEN_INT: for (n = 0; n < count; n++) result[n] = floor(vp[n]); break;
+  case BASIC_TOKEN_LN:  for (n = 0; n < count; n++) result[n] = log(vp[n]); break;
+  case BASIC_TOKEN_SIN: for (n = 0; n < count; n++) result[n] = sin(vp[n]); break;
+  default:              for (n = 0; n < count; n++) result[n] = sqrt(vp[n]);
+  }
+}
+
+/*
+** 'fuse_run' runs the program 'prog' over all the elements of the
+** destination array. If 'store' is FALSE the results are thrown away:
+** the program is just being run to see if it gives an error
+*/
+static void fuse_run(fuseprog *prog, boolean store) {
+  fuseitem stack[FUSEMAXDEPTH], *ip;
+  float64 *result, *dest;
+  int32 base, count, n, sp;
+  for (base = 0; base < prog->shape->arrsize; base+=FUSEBLOCK) {
+    count = prog->shape->arrsize-base;
+    if (count > FUSEBLOCK) count = FUSEBLOCK;
+    dest = store ? prog->shape->arraystart.floatbase+base : fusescratch;
+    sp = 0;
+    for (n = 0; n < prog->count; n++) {
+      ip = &prog->items[n];
+      if (ip->operator == 0) {
+        stack[sp].vector = ip->vector != NIL ? ip->vector+base : NIL;
+        stack[sp].scalar = ip->scalar;
+        sp++;
+      } else if (ip->operator == FUSEFUNCTION) {
+        result = n == prog->count-1 ? dest : fusebuffer[sp-1];
+        fuse_apply(ip->function, result, stack[sp-1].vector, count);
+        stack[sp-1].vector = result;
+      } else {
+        sp--;
+        result = n == prog->count-1 ? dest : fusebuffer[sp-1];
+        fuse_block(ip->operator, result, &stack[sp-1], &stack[sp], count);
+        stack[sp-1].vector = result;
+      }
+    }
+  }
+}
+
+/*
+** 'fuse_floatarray' tries to evaluate the expression on the right hand
+** side of an assignment to the floating point array 'ap' in a single
+** pass. It returns TRUE if it managed it or FALSE if the assignment
+** has to be carried out in the normal way, in which case
+** 'basicvars.current' is left pointing at the start of the expression
+*/
+static boolean fuse_floatarray(basicarray *ap) {
+  fuseprog prog;
+  byte *start;
+  boolean isvector;
+  if (ap == NIL) return FALSE;
+  start = basicvars.current;
+  prog.shape = ap;
+  prog.count = prog.depth = prog.maxdepth = 0;
+  prog.mustcheck = FALSE;
+  if (!fuse_expression(&prog, &isvector) || !ateol[*basicvars.current]
+   || prog.count < 2 || prog.maxdepth > FUSEMAXDEPTH) {
+    basicvars.current = start;
+    return FALSE;
+  }
+  if (prog.mustcheck) fuse_run(&prog, FALSE);
+  fuse_run(&prog, TRUE);
+  return TRUE;
+}
+
 /*
 ** The main purpose of 'exec_assignment' is to deal with the more complex
 ** assignments. However all assignments are handled by this function the
@@ -2220,8 +2600,16 @@ void exec_assignment(void) {
   assignop = *basicvars.current;
   if (assignop=='=') {
     basicvars.current++;
-    expression();
-    (*assign_table[destination.typeinfo])(destination.address);
+    if (destination.typeinfo==VAR_STRINGDOL) {
+      if (!share_stringvar(destination.address.straddr)) {
+        expression();
+        assign_stringdol(destination.address);
+      }
+    }
+    else if (destination.typeinfo!=VAR_FLOATARRAY || !fuse_floatarray(*destination.address.arrayaddr)) {
+      expression();
+      (*assign_table[destination.typeinfo])(destination.address);
+    }
   }
   else if (assignop==BASIC_TOKEN_PLUSAB) {
     basicvars.current++;
@@ -2606,8 +2994,10 @@ void assign_stringvar(void) {
   assignop = *basicvars.current;
   basicvars.current++;
   if (assignop=='=') {
-    expression();
-    assign_stringdol(address);
+    if (!share_stringvar(address.straddr)) {
+      expression();
+      assign_stringdol(address);
+    }
   }
   else if (assignop==BASIC_TOKEN_PLUSAB) {
     expression();
@@ -2736,7 +3126,7 @@ static void assign_left(void) {
   rhstring = pop_string();
   if (count>rhstring.stringlen) count = rhstring.stringlen;
   if (destination.typeinfo==VAR_STRINGDOL)	/* Left-hand string is a string variable */
-    lhstring = *destination.address.straddr;
+    lhstring = own_stringvar(destination.address.straddr);
   else {	/* Left-hand string is a '$<addr>' string, so fake a descriptor for it */
     lhstring.stringaddr = CAST(&basicvars.offbase[destination.address.offset], char *);
     lhstring.stringlen = get_stringlen(destination.address.offset);
@@ -2812,7 +3202,7 @@ static void assign_mid(void) {
   if (stringtype!=STACK_STRING && stringtype!=STACK_STRTEMP) error(ERR_TYPESTR);
   rhstring = pop_string();
   if (destination.typeinfo==VAR_STRINGDOL)	/* Left-hand string is a string variable */
-    lhstring = *destination.address.straddr;
+    lhstring = own_stringvar(destination.address.straddr);
   else {	/* Left-hand string is a '$<addr>' string, so fake a descriptor for it */
     lhstring.stringaddr = CAST(&basicvars.offbase[destination.address.offset], char *);
     lhstring.stringlen = get_stringlen(destination.address.offset);
@@ -2895,7 +3285,7 @@ static void assign_right(void) {
   rhstring = pop_string();
   if (count>0) {	/* Only do anything if count is greater than zero */
     if (destination.typeinfo==VAR_STRINGDOL)	/* Left-hand string is a string variable */
-      lhstring = *destination.address.straddr;
+      lhstring = own_stringvar(destination.address.straddr);
     else {	/* Left-hand string is a '$<addr>' string, so fake a descriptor for it */
       lhstring.stringaddr = CAST(&basicvars.offbase[destination.address.offset], char *);
       lhstring.stringlen = get_stringlen(destination.address.offset);
@@ -2953,6 +3343,8 @@ void assign_pseudovar(void) {
   token = *basicvars.current;
   if (token>=BASIC_TOKEN_HIMEM && token<=BASIC_TOKEN_TIMEDOL)
     (*pseudovars[token])();	/* Dispatch an assignment to a pseudo variable */
+  else if (token==BASIC_TOKEN_BGET)	/* 'BGET#' statement to read whole arrays */
+    exec_bget();
   else if (token<=BASIC_TOKEN_VPOS)	/* Function call on left hand side of assignment */
     error(ERR_SYNTAX);
   else {
@@ -186,6 +186,16 @@ typedef struct formparm {
   lvalue parameter;			/* Parameter's details */
 } formparm;
 
+/* 'localcache' records the variables made local by one 'LOCAL' statement in a PROC or FN */
+
+typedef struct localcache {
+  struct localcache *nextcache;		/* Next cached 'LOCAL' statement */
+  byte *localaddr;			/* Address of first variable in statement */
+  byte *localend;			/* Address of token after last variable */
+  int32 localcount;			/* Number of variables */
+  lvalue localvars[1];			/* Variables' details (more follow) */
+} localcache;
+
 /* 'fnprocdef' gives details of a procedure's or function's formal parameters */
 
 typedef struct {
@@ -193,6 +203,7 @@ typedef struct {
   int32 parmcount;			/* Number of parameters */
   boolean simple;			/* PROC/FN has only one integer parameter */
   formparm *parmlist;			/* Pointer to first parameter */
+  localcache *localist;			/* Pointer to first cached 'LOCAL' statement */
 } fnprocdef;
 
 /* 'variable' is the main structure used to define a variable */
@@ -222,6 +233,7 @@ typedef struct fnprocinfo {
   byte *retaddr;			/* Return address in program */
   int32 parmcount;			/* Number of parameters on stack for call */
   char *fnprocname;			/* Pointer to FN's or PROC's name */
+  fnprocdef *fnprocdp;			/* Pointer to FN's or PROC's definition */
 } fnprocinfo;
 
 /* 'gosubinfo' contains the information saved on the Basic stack */
@@ -241,9 +253,11 @@ typedef struct {
 /* 'libfnproc' entries are set up for each procedure or function in a library */
 
 typedef struct libfnproc {
-  struct libfnproc *fpflink;		/* Pointer to next PROC/FN entry */
+  struct libfnproc *fpflink;		/* Pointer to next PROC/FN entry in index hash chain */
+  struct library *fplib;		/* Library containing the PROC/FN */
   byte *fpline;				/* Pointer to start of line containing DEF PROC/FN */
   int32 fphash;				/* Hash value of PROC/FN's name */
+  int32 fpnamelen;			/* Length of PROC/FN's name */
   byte *fpname;				/* Pointer to PROC/FN's name in source line */
   byte *fpmarker;			/* Pointer to XFNPROCALL token in executable line */
 } libfnproc;
@@ -255,7 +269,7 @@ typedef struct library {
   char *libname;			/* Library name */
   byte *libstart;			/* Pointer to start of library in memory */
   int32 libsize;			/* Size of library */
-  libfnproc *libfplist;			/* Pointer to list of procedures and functions in library */
+  boolean libscanned;			/* TRUE if library's private variables have been created */
   variable *varlists[VARLISTS];		/* Pointers to lists of variables, procedures and functions in library */
 } library;
 
@@ -269,7 +283,7 @@ typedef enum {
   STACK_GOSUB,      STACK_PROC,     STACK_FN,         STACK_LOCAL,		/* 14 */
   STACK_RETPARM,    STACK_WHILE,    STACK_REPEAT,     STACK_INTFOR,		/* 18 */
   STACK_INT64FOR,   STACK_FLOATFOR, STACK_ERROR,      STACK_DATA,		/* 1C */
-  STACK_OPSTACK,    STACK_RESTART,  STACK_HIGHEST				/* 1F */
+  STACK_OPSTACK,    STACK_RESTART,  STACK_LOCALBLOCK, STACK_HIGHEST		/* 20 */
 } stackitem;
 
 typedef struct {		/* Operator stack */
@@ -347,6 +361,20 @@ typedef struct {		/* Saved local variable */
   } value;
 } stack_local;
 
+typedef union {		/* Value saved for one variable in a block of LOCAL variables */
+  int32 savedint;		/* Saved 32-bit integer value */
+  int64 savedint64;		/* Saved 64-bit integer value */
+  float64 savedfloat;		/* Saved floating point value */
+  basicstring savedstring;	/* Saved string descriptor */
+  basicarray *savedarray;	/* Saved pointer to array descriptor */
+} savedvalue;
+
+typedef struct {		/* Block of saved local variables. The values follow it */
+  stackitem itemtype;
+  int32 localcount;		/* Number of variables saved */
+  lvalue *localvars;		/* Details of variables saved (from PROC/FN's LOCAL cache) */
+} stack_localblock;
+
 typedef struct {		/* Saved RETURN-type local variable */
   stackitem itemtype;
   lvalue savedetails;		/* Details of item saved */
@@ -404,6 +432,7 @@ typedef union {		/* This type represents everything that goes on the stack */
   stack_fn *fnsp;
   stack_gosub *gosubsp;
   stack_local *localsp;
+  stack_localblock *localblocksp;
   stack_retparm *retparmsp;
   stack_while *whilesp;
   stack_repeat *repeatsp;
@@ -438,6 +467,7 @@ typedef struct {
   byte *lomem;				/* Address of start of variables and data */
   byte *vartop;				/* Address of top of variables and data */
   stack_pointer stacklimit;		/* Point beyond which stack dares not tread */
+  byte *cstacklimit;			/* Lowest safe address for the C stack or NIL if not known */
   stack_pointer stacktop;		/* Basic stack pointer (full, descending stack) */
   stack_pointer safestack;		/* Value Basic stack pointer is set to after an error */
   byte *himem;				/* Address of top of basic stack */
@@ -473,6 +503,7 @@ typedef struct {
     unsigned int flag_cosmetic:1;	/* TRUE if all unsupported features flagged as errors */
     unsigned int ignore_starcmd:1;	/* TRUE if built-in '*' commands are ignored */
     unsigned int startfullscreen:1;	/* TRUE if we start in fullscreen in SDL mode */
+    unsigned int has_localerror:1;	/* TRUE if program or libraries contain 'ON ERROR LOCAL' */
   } runflags;				/* Various runtime flags */
   struct {
     unsigned int enabled:1;		/* TRUE if any trace options are enabled */
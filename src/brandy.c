@@ -40,6 +40,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#if defined(TARGET_UNIX) | defined(TARGET_MACOSX) | defined(TARGET_GNU)
+#include <sys/resource.h>
+#endif
 #include "common.h"
 #include "basicdefs.h"
 #include "tokens.h"
@@ -87,6 +90,27 @@ static char *loadfile;			/* Pointer to name of file to load when interpreter sta
 ** (in statement.c) is invoked. 'exec_quit' handles the 'QUIT' command
 */
 
+#define CSTACKMARGIN (256*1024)	/* C stack kept in reserve for error handling */
+
+/*
+** 'init_cstack' notes how far the C stack can grow. A call to a Basic
+** function recurses through the expression code so deep recursion can
+** use up the C stack long before the Basic stack is full. Knowing the
+** limit lets 'do_function' report this as an error instead of the
+** interpreter crashing. 'base' is an address near the top of the stack
+*/
+static void init_cstack(void *base) {
+#if defined(TARGET_UNIX) | defined(TARGET_MACOSX) | defined(TARGET_GNU)
+  struct rlimit limit;
+  basicvars.cstacklimit = NIL;
+  if (getrlimit(RLIMIT_STACK, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) return;
+  if (limit.rlim_cur <= 2*CSTACKMARGIN) return;
+  basicvars.cstacklimit = CAST(base, byte *)-(limit.rlim_cur-CSTACKMARGIN);
+#else
+  basicvars.cstacklimit = NIL;
+#endif
+}
+
 int main(int argc, char *argv[]) {
 // Hmmm. Why doesn't this work?
 //#ifdef TARGET_RISCOS
@@ -106,6 +130,7 @@ int main(int argc, char *argv[]) {
   check_cmdline(argc, argv);
 #endif
   init2();
+  init_cstack(&argc);
   gpio_init();
   run_interpreter();
   return EXIT_FAILURE;
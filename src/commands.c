@@ -142,6 +142,7 @@ static void exec_new(void) {
     newsize = get_number();
     check_ateol();
     oldsize = basicvars.worksize;
+    clear_varptrs();				/* Patch log refers to the old workspace */
     release_workspace();                        /* Discard horrible, rusty old Basic workspace */
     ok = init_workspace(ALIGN(newsize));        /* Obtain nice, shiny new one */
     if (!ok) {  /* Allocation failed - Should still be a block of the old size available */
@@ -349,7 +350,7 @@ static void show_memory(void) {
 */
 static void list_program(void) {
   size_t lowline, highline;
-  int32 count;
+  int32 count, length;
   boolean more, paused;
   byte *p;
   if (basicvars.misc_flags.badprogram) error(ERR_BADPROG);
@@ -367,11 +368,13 @@ static void list_program(void) {
   count = 0;
   more = TRUE;
   while (more && !AT_PROGEND(p) && get_lineno(p)<=highline) {
-    expand(p, basicvars.stringwork);
+    length = expand(p, basicvars.stringwork);
     if (basicvars.debug_flags.tokens)
       emulate_printf("%p  %s\r\n", p, basicvars.stringwork);
     else {
-      emulate_printf("%s\r\n", basicvars.stringwork);
+      basicvars.stringwork[length++] = asc_CR;
+      basicvars.stringwork[length++] = asc_LF;
+      emulate_vdustr(basicvars.stringwork, length);
     }
     p+=GET_LINELEN(p);
     if (basicvars.list_flags.showpage) {
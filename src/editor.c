@@ -48,10 +48,12 @@
 
 #define MARKERSIZE 4
 #define ENDMARKSIZE 8		/* Size of the sentinel value at the end of the program */
+#define SAVEBUFSIZE (16*MAXSTRING)	/* Size of buffer used when saving a program as text */
 
 #define ACORN_ENDMARK 0xffu	/* Marker denoting end of Acorn Basic file */
 
 static byte *last_added;	/* Address of last line added to program */
+static char *savebuffer;	/* Buffer used when saving a program as text */
 static boolean needsnumbers;	/* TRUE if a program need to be renumbered */
 
 #ifdef BRANDYAPP
@@ -185,9 +187,12 @@ static void do_scrunge(int len, char *buf)
 ** 'clear_program' is called when a 'NEW' command is issued to clear the old
 ** program from memory. The start of an existing program is preserved in
 ** 'oldstart' in case 'OLD' is used so that the old program can be restored
-** to health
+** to health. Any references filled in in the old program and installed
+** libraries are undone first as they would otherwise be left behind
+** once the patch log is discarded
 */
 void clear_program(void) {
+  clear_varptrs();
   clear_varlists();
   clear_strings();
   clear_heap();
@@ -265,6 +270,7 @@ static boolean isvalidprog(void) {
 */
 void recover_program(void) {
   byte *bp=NULL;
+  clear_varptrs();	/* Undo references in any program entered since 'NEW' */
   if (basicvars.misc_flags.validsaved) {	/* Only check if the command 'new' has been used */
     reinstate();		/* Restore start of program */
     bp = basicvars.start;
@@ -318,6 +324,7 @@ static void clear_refs(void) {
     }
   }
   basicvars.liblist = NIL;
+  clear_libindex();
   basicvars.runflags.has_offsets = FALSE;
   basicvars.runflags.has_variables = FALSE;
 }
@@ -400,43 +407,54 @@ void delete_range(int32 low, int32 high) {
 
 /*
 ** 'renumber' renumbers the lines in the program starting at 'progstart'.
-** It does this in three passes. On the first, it goes through and resolves
-** all the line number references it can. It then renumbers the program.
-** The last step is to go through all the line numbers again and replace
-** the old line numbers with the new. As a bonus, all of the line number
-** pointers in the program are left pointing at the right lines.
+** It first builds a table of the addresses of the lines and a map from
+** the old line numbers to entries in that table. The map only covers
+** line numbers up to the highest one in the program. Both the line numbers
+** and the references to them are then updated in a single pass over the
+** program. As a bonus, all of the line number pointers in the program
+** are left pointing at the right lines. If the new numbers will not fit
+** but numbering from 1 in steps of 1 would, that is done before the
+** error is reported. Otherwise the program is left unchanged
 */
 void renumber_program(byte *progstart, int32 start, int32 step) {
-  byte *bp;
+  byte *bp, **lines;
+  int32 *linemap;
+  int32 n, count, line, highline;
   boolean ok;
-  bp = progstart;
-  while (!AT_PROGEND(bp) && start<=MAXLINENO) {
-    resolve_linenums(bp);
-    bp+=get_linelen(bp);
+  count = 0;
+  highline = 0;
+  for (bp = progstart; !AT_PROGEND(bp); bp+=get_linelen(bp)) {
+    line = get_lineno(bp);
+    if (line>highline && line<=MAXLINENO) highline = line;
+    count++;
   }
-  bp = progstart;
-  while (!AT_PROGEND(bp) && start<=MAXLINENO) {
-    save_lineno(bp, start);
-    start+=step;
-    bp+=get_linelen(bp);
+  if (count==0) return;
+  ok = start<=MAXLINENO && start+(int64)(count-1)*step<=MAXLINENO;
+  if (!ok) {	/* Oops... Line numbers will not fit */
+    if (step==1 || count>MAXLINENO) error(ERR_RENUMBER);
+    start = step = 1;	/* Try to fix line numbers */
   }
-  ok = AT_PROGEND(bp);
-  if (!ok) {	/* Oops... Did not stop at end of program */
-    if (step!=1) { 	   /* Try to fix line numbers */
-      start = 1;
-      bp = progstart;
-      while (!AT_PROGEND(bp) && start<=MAXLINENO) {
-        save_lineno(bp, start);
-        start++;
-        bp+=get_linelen(bp);
-      }
-    }
+  lines = malloc(count*sizeof(byte *));
+  linemap = malloc((highline+1)*sizeof(int32));
+  if (lines==NIL || linemap==NIL) {
+    free(lines);
+    free(linemap);
+    error(ERR_NOROOM);
   }
+  for (line = 0; line<=highline; line++) linemap[line] = -1;
   bp = progstart;
-  while (!AT_PROGEND(bp) && start<=MAXLINENO) {
-    reset_linenums(bp);
+  for (n = 0; n<count; n++) {
+    lines[n] = bp;
+    line = get_lineno(bp);
+    if (line>=0 && line<=highline && linemap[line]<0) linemap[line] = n;
     bp+=get_linelen(bp);
   }
+  for (n = 0; n<count; n++) {
+    save_lineno(lines[n], start+n*step);
+    renumber_linerefs(lines[n], lines, count, linemap, highline, start, step);
+  }
+  free(lines);
+  free(linemap);
   if(!ok) error(ERR_RENUMBER);
 }
 
@@ -834,8 +852,10 @@ static void link_library(char *name, byte *base, int32 size, boolean onheap) {
   strcpy(lp->libname, name);
   lp->libstart = base;
   lp->libsize = size;
-  lp->libfplist = NIL;
+  lp->libscanned = FALSE;
   for (n=0; n<VARLISTS; n++) lp->varlists[n] = NIL;
+  scan_localerror(base);
+  index_library(lp, onheap);
 }
 
 /*
@@ -927,30 +947,68 @@ void read_library(char *name, boolean onheap) {
 }
 
 /*
-** 'write_text' is called to save a program in text form
+** 'replace_library' is used to change procedures and functions whilst a
+** program is running. It loads library 'name' on to the Basic heap, as
+** 'LIBRARY' does but even if a library of that name has been loaded
+** before, and then makes its procedures and functions replace those of
+** the same name. Variables are left alone. The replacements last until
+** the heap is cleared, for example by 'RUN' or 'CLEAR'. The function
+** returns the number of procedures and functions in the library
+*/
+int32 replace_library(char *name) {
+  FILE *libfile;
+  int32 ftype;
+  libfile = open_file(name);
+  if (libfile == NIL) error(ERR_NOLIB, name);		/* Cannot find library */
+  if ((ftype=identify(libfile, name)) != TEXTFILE)
+    read_bbclib(libfile, name, TRUE, ftype);
+  else {
+    read_textlib(libfile, name, TRUE);
+  }
+  return replace_fnprocs(basicvars.liblist);	/* New library is at the head of the list */
+}
+
+/*
+** 'write_text' is called to save a program in text form. The lines are
+** expanded one after the other into a large buffer which is written out
+** whenever it might not have room for the next line. The buffer is kept
+** for later saves. If it cannot be allocated the string workspace is used,
+** one line at a time
 */
 void write_text(char *name, FILE *fhandle) {
   FILE *savefile;
   byte *bp;
-  int32 x;
+  char *buffer;
+  size_t size, used;
+  boolean ok;
   if (fhandle) {
     savefile = fhandle;
   } else {
     savefile = fopen(name, "w");
   }
   if (savefile==NIL) error(ERR_NOTCREATED, name);
+  if (savebuffer==NIL) savebuffer = malloc(SAVEBUFSIZE);
+  buffer = savebuffer;
+  size = SAVEBUFSIZE;
+  if (buffer==NIL) {
+    buffer = basicvars.stringwork;
+    size = MAXSTRING;
+  }
+  used = 0;
+  ok = TRUE;
   bp = basicvars.start;
-  while (!AT_PROGEND(bp)) {
-    expand(bp, basicvars.stringwork);
-    x = fputs(basicvars.stringwork, savefile);
-    if (x!=EOF) x = fputc('\n', savefile);
-    if (x==EOF) {	/* Error occured writing to file */
-      fclose(savefile);
-      error(ERR_WRITEFAIL, name);
+  while (ok && !AT_PROGEND(bp)) {
+    if (used>0 && size-used<MAXSTRING) {	/* Next line might not fit */
+      ok = fwrite(buffer, 1, used, savefile)==used;
+      used = 0;
     }
+    used+=expand(bp, buffer+used);
+    buffer[used++] = '\n';
     bp+=get_linelen(bp);
   }
+  if (ok && used>0) ok = fwrite(buffer, 1, used, savefile)==used;
   fclose(savefile);
+  if (!ok) error(ERR_WRITEFAIL, name);	/* Error occured writing to file */
 }
 
 /*
@@ -42,6 +42,7 @@ extern void read_basic_block(void);
 #endif
 extern void write_basic(char *);
 extern void read_library(char *, boolean);
+extern int32 replace_library(char *);
 extern void write_text(char *, FILE *);
 extern boolean validate_program(void);
 extern boolean recover_program(void);
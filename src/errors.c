@@ -568,6 +568,7 @@ static detail errortable [] = {
 /* ERR_NET_MAXSOCKETS */{NONFATAL, NOPARM, 192, "The maximum allowed number of sockets is already open"},
 /* ERR_NET_NOTSUPP */	{NONFATAL, NOPARM, 157, "Network operation not supported"},	// 'Unsupported operation'
 /* ERR_NO_RPI_GPIO */	{NONFATAL, NOPARM, 510, "Raspberry Pi GPIO not available"},
+/* ERR_FNDEPTH */	{NONFATAL, NOPARM,  37, "Function calls are nested too deeply"},		// 'Too many GOSUBs'
 //
 /* HIGHERROR */		{NONFATAL, NOPARM,   0, "You should never see this"} /* ALWAYS leave this as the last error */
 };
@@ -714,8 +715,13 @@ static void handle_error(errortype severity) {
      basicvars.error_handler.current, basicvars.error_handler.stacktop, basicvars.opstop);
   }
 #endif
-    if (basicvars.error_handler.islocal)        /* Trapped via 'ON ERROR LOCAL' */
+    if (basicvars.error_handler.islocal) {      /* Trapped via 'ON ERROR LOCAL' */
+      if (basicvars.local_restart == NIL) {	/* Function has no restart block - Cannot return to handler */
+        basicvars.error_handler.current = NIL;
+        handle_error(severity);
+      }
       siglongjmp(*basicvars.local_restart, 1);
+    }
     else {      /* Trapped via 'ON ERROR' - Reset everything and return to main interpreter loop */
       basicvars.procstack = NIL;
       basicvars.gosubstack = NIL;
@@ -859,6 +865,29 @@ void set_local_error(void) {
 #endif
 }
 
+/*
+** 'scan_localerror' checks the program or library starting at 'lp' for
+** 'ON ERROR LOCAL' statements and sets the 'has_localerror' flag if it
+** finds any. A function call only needs a restart block for 'siglongjmp'
+** if an 'ON ERROR LOCAL' can be executed while the function is active.
+** When none can be, 'do_function' skips the 'setjmp' and the call costs
+** no more than a procedure call
+*/
+void scan_localerror(byte *lp) {
+  byte *tp;
+  while (!AT_PROGEND(lp)) {
+    tp = FIND_EXEC(lp);
+    while (*tp != asc_NUL) {
+      if (*tp == BASIC_TOKEN_ERROR && *(tp+1) == BASIC_TOKEN_LOCAL) {
+        basicvars.runflags.has_localerror = TRUE;
+        return;
+      }
+      tp = skip_token(tp);
+    }
+    lp+=GET_LINELEN(lp);
+  }
+}
+
 /*
 ** 'clear_error' is called to clear any error handler set up by the
 ** Basic program
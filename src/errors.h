@@ -28,6 +28,8 @@
 #ifndef __errors_h
 #define __errors_h
 
+#include "common.h"
+
 /* Basic error numbers */
 
 typedef enum {
@@ -198,6 +200,7 @@ typedef enum {
     ERR_NET_MAXSOCKETS,	/* 246, Maximum number of sockets already open */
     ERR_NET_NOTSUPP,	/* 246, Network operation not supported */
     ERR_NO_RPI_GPIO,	/* 510, Raspberry Pi GPIO not available */
+    ERR_FNDEPTH,	/* Functions are nested too deeply for the C stack */
     HIGHERROR		/* Leave last, dummy error */
 } errnum;
 
@@ -219,6 +222,7 @@ extern void show_error(int32, char *);
 extern void set_error(void);
 extern void set_local_error(void);
 extern void clear_error(void);
+extern void scan_localerror(byte *);
 extern void show_help(void);
 extern void show_options(int32);
 extern void announce(void);
@@ -67,6 +67,13 @@
 
 #define OPSTACKMARK 0			/* 'Operator' used as sentinel at the base of the operator stack */
 
+/*
+** The 32-bit integer operators wrap around if the result does not fit
+** in 32 bits. The arithmetic is done unsigned as signed overflow is
+** undefined in C
+*/
+#define WRAP_INT32(x, op, y) CAST(CAST(x, uint32) op CAST(y, uint32), int32)
+
 static float64 floatvalue;		/* Temporary for holding floating point values */
 static int64 int64value;		/* Temporary for holding 64-bit integers */
 /*
@@ -319,6 +326,7 @@ static void push_oneparm(formparm *fp, int32 parmno, char *procname) {
   float64 floatparm = 0;
   basicstring stringparm = {0, NULL};
   basicarray *arrayparm = NULL;
+  basicstring *srcvar = NIL;
   lvalue retparm;
   stackitem parmtype = STACK_UNKNOWN;
   boolean isreturn;
@@ -328,6 +336,8 @@ static void push_oneparm(formparm *fp, int32 parmno, char *procname) {
 #endif
   isreturn = (fp->parameter.typeinfo & VAR_RETURN) != 0;
   if (!isreturn) {	/* Normal parameter */
+    if (*basicvars.current == BASIC_TOKEN_STRINGVAR && (basicvars.current[LOFFSIZE+1] == ',' || basicvars.current[LOFFSIZE+1] == ')'))
+      srcvar = GET_ADDRESS(basicvars.current, basicstring *);	/* Argument is just a string variable */
     expression();
     parmtype = GET_TOPITEM;
     if (parmtype == STACK_INT)
@@ -360,6 +370,7 @@ static void push_oneparm(formparm *fp, int32 parmno, char *procname) {
       break;
     case VAR_STRINGDOL:		/* Normal string parameter */
       stringparm = *retparm.address.straddr;
+      srcvar = retparm.address.straddr;
       parmtype = STACK_STRING;
       break;
     case VAR_INTBYTEPTR:	/* Indirect byte-sized integer */
@@ -518,7 +529,11 @@ static void push_oneparm(formparm *fp, int32 parmno, char *procname) {
     else {
       save_string(fp->parameter, *p);
     }
-    if (parmtype == STACK_STRING) {	/* Argument is a string variable - Have to copy string */
+    if (srcvar != NIL && srcvar->stringaddr == stringparm.stringaddr && srcvar->stringlen == stringparm.stringlen)
+      *p = share_string(stringparm);	/* Argument is still the string in a string variable - Share it */
+    else if (parmtype == STACK_STRING && stringparm.stringlen == 1)
+      *p = char_string(*stringparm.stringaddr);
+    else if (parmtype == STACK_STRING) {	/* Argument is a string variable - Have to copy string */
       p->stringlen = stringparm.stringlen;
       p->stringaddr = alloc_string(stringparm.stringlen);
       if (stringparm.stringlen > 0) memmove(p->stringaddr, stringparm.stringaddr, stringparm.stringlen);
@@ -1301,7 +1316,19 @@ static void do_getfloat(void) {
 ** block with a pointer to that block held with the rest of the Basic
 ** variables in 'basicvars'. The existing pointer is saved by the call
 ** 'push_fn'. Note that 'push_fn' also saves the operator stack pointer.
+** The environment block is only needed if an 'ON ERROR LOCAL' can be
+** executed while the function is active. If the program and libraries
+** do not contain one ('has_localerror' is not set) the block and the
+** call to 'setjmp' are skipped and the function body is just called.
 **
+** Procedure calls do not use the C stack at all, so the depth to which
+** they can recurse is limited only by the size of the Basic stack, but
+** each function call nests a call to 'expression' and so forth. All
+** versions of the program therefore check how much C stack is left. On
+** Unix-like systems the limit is worked out at start up ('cstacklimit')
+** and running out of C stack gives an error that the program can trap
+** instead of the interpreter being killed. The function depth is still
+** limited by the C stack and not by the size of the Basic workspace.
 ** The DJGPP version of the program includes a check for the amount of
 ** C stack left in this function. This is needed as there are no checks
 ** for stack overflow in this environment (the gcc option '-fstack-check'
@@ -1323,6 +1350,8 @@ static void do_function(void) {
 #endif
 #ifdef TARGET_DJGPP
   if (stackavail()<DJGPPLIMIT) error(ERR_STACKFULL);
+#else
+  if (CAST(&dp, byte *)<basicvars.cstacklimit) error(ERR_FNDEPTH);
 #endif
   vp = GET_ADDRESS(basicvars.current, variable *);
   dp = vp->varentry.varfnproc;
@@ -1334,27 +1363,33 @@ static void do_function(void) {
 
 /* Save everything */
 
-  push_fn(vp->varname, dp->parmcount);
+  push_fn(vp->varname, dp);
   tp = basicvars.current;
 
 /* Lastly, create a new operator stack and call the function */
 
   basicvars.opstop = make_opstack();
   basicvars.opstlimit = basicvars.opstop+OPSTACKSIZE;
-  basicvars.local_restart = make_restart();
   if (basicvars.traces.enabled) {
     if (basicvars.traces.procs) trace_proc(vp->varname, TRUE);
     if (basicvars.traces.branches) trace_branch(basicvars.current, dp->fnprocaddr);
   }
-  if (setjmp(*basicvars.local_restart) == 0)
+  if (!basicvars.runflags.has_localerror) {	/* No 'ON ERROR LOCAL' can return here */
+    basicvars.local_restart = NIL;
     exec_fnstatements(dp->fnprocaddr);
+  }
   else {
+    basicvars.local_restart = make_restart();
+    if (setjmp(*basicvars.local_restart) == 0)
+      exec_fnstatements(dp->fnprocaddr);
+    else {
 /*
 ** Restart here after an error in the function or something
 ** called from it is trapped by ON ERROR LOCAL
 */
-    reset_opstack();
-    exec_fnstatements(basicvars.error_handler.current);
+      reset_opstack();
+      exec_fnstatements(basicvars.error_handler.current);
+    }
   }
 
 /* Restore stuff after the call has ended */
@@ -1493,18 +1528,7 @@ static void eval_ivplus(void) {
   int32 rhint32 = pop_int();	/* Top item on Basic stack is right-hand operand */
   lhitem = GET_TOPITEM;
   if (lhitem == STACK_INT) {
-    if (matrixflags.legacyintmaths) {
-      INCR_INT(rhint32);		/* int+int - Update value on stack in place */
-    } else {
-      int64 lhint64;
-      int32 lhint32=pop_int();
-      lhint64 = (int64)(lhint32 + rhint32);
-      lhint32 += rhint32;
-      if (lhint64 == lhint32)
-        push_int(lhint32);
-      else
-        push_int64(lhint64);
-    }
+    SET_TOPINT(WRAP_INT32(GET_TOPINT, +, rhint32));	/* int+int - Update value on stack in place */
   } else if (lhitem == STACK_INT64) {
     int64 lhint64;
     int32 lhint32;
@@ -1627,7 +1651,7 @@ static void eval_fvplus(void) {
     PUSH_FLOAT(floatvalue);		
   } else if (lhitem == STACK_FLOAT)
     INCR_FLOAT(floatvalue);
-  else if (lhitem == STACK_INTARRAY || STACK_INT64ARRAY || lhitem == STACK_FLOATARRAY) {	/* <array>+<float value> */
+  else if (lhitem == STACK_INTARRAY || lhitem == STACK_INT64ARRAY || lhitem == STACK_FLOATARRAY) {	/* <array>+<float value> */
     basicarray *lharray;
     float64 *base;
     int32 n, count;
@@ -1959,18 +1983,7 @@ static void eval_ivminus(void) {
   int32 rhint32 = pop_int();
   lhitem = GET_TOPITEM;
   if (lhitem == STACK_INT) {	/* Branch according to type of left-hand operand */
-    if (matrixflags.legacyintmaths) {
-      DECR_INT(rhint32);
-    } else {
-      int64 lhint64;
-      int32 lhint32=pop_int();
-      lhint64=(int64)(lhint32-rhint32);
-      lhint32 -= rhint32;
-      if (lhint64 == lhint32)
-        push_int(lhint32);
-      else
-       push_int64(lhint64);
-    }
+    SET_TOPINT(WRAP_INT32(GET_TOPINT, -, rhint32));	/* int-int - Update value on stack in place */
   } else if (lhitem == STACK_INT64) {	/* Branch according to type of left-hand operand */
     int32 lhint32;
     int64 lhint64=pop_int64();
@@ -2284,37 +2297,18 @@ static void eval_faminus(void) {
 /*
 ** 'eval_ivmul' handles multiplication where the right-hand operand is
 ** a 32-bit integer.
-** Note that in order to catch an integer overflow, the operands have
-** to be converted to floating point before they are multiplied so that
-** the result can be checked to see if it is in range still. There
-** should be no problem here as long as the number of bits in the
-** mantissa of the floating point number exceeds the number of bits
-** in an integer
+** The product of two 32-bit integers wraps around in the same way as
+** addition and subtraction
 */
 static void eval_ivmul(void) {
   stackitem lhitem;
   int32 rhint32 = pop_int();
   lhitem = GET_TOPITEM;
   if (lhitem == STACK_INT) {	/* Now look at left-hand operand */
-    float64 lhfloat;
-    int64 lhint64;
-    int32 lhint32 = pop_int();
-    lhint64 = (int64)lhint32;
-    lhfloat=TOFLOAT(lhint32);
-    lhint32 *= rhint32;
-    lhint64 *= rhint32;
-    lhfloat *= TOFLOAT(rhint32);
-    if (lhint64 == lhint32)
-      push_int(lhint32);
-    else {
-      if (llabs((int64)lhfloat) >= MAXINT64VAL)
-        push_float(lhfloat);
-      else
-        push_int64(lhint64);
-    }
+    SET_TOPINT(WRAP_INT32(GET_TOPINT, *, rhint32));	/* int*int - Update value on stack in place */
   } else if (lhitem == STACK_FLOAT)
     push_float(pop_float()*TOFLOAT(rhint32));
-  else if (lhitem == STACK_INTARRAY || STACK_INT64ARRAY || lhitem == STACK_FLOATARRAY) {	/* <array>*<integer value> */
+  else if (lhitem == STACK_INTARRAY || lhitem == STACK_INT64ARRAY || lhitem == STACK_FLOATARRAY) {	/* <array>*<integer value> */
     basicarray *lharray;
     int32 n, count;
     lharray = pop_array();
@@ -2389,7 +2383,7 @@ static void eval_iv64mul(void) {
     }
   } else if (lhitem == STACK_FLOAT)
     push_float(pop_float()*TOFLOAT(rhint64));
-  else if (lhitem == STACK_INTARRAY || STACK_INT64ARRAY || lhitem == STACK_FLOATARRAY) {	/* <array>*<integer value> */
+  else if (lhitem == STACK_INTARRAY || lhitem == STACK_INT64ARRAY || lhitem == STACK_FLOATARRAY) {	/* <array>*<integer value> */
     basicarray *lharray;
     int32 n, count;
     lharray = pop_array();
@@ -2451,7 +2445,7 @@ static void eval_fvmul(void) {
     push_float(TOFLOAT(pop_int64())*floatvalue);
   else if (lhitem == STACK_FLOAT)
     push_float(pop_float()*floatvalue);
-  else if (lhitem == STACK_INTARRAY || STACK_INT64ARRAY || lhitem == STACK_FLOATARRAY) {	/* <array>*<float value> */
+  else if (lhitem == STACK_INTARRAY || lhitem == STACK_INT64ARRAY || lhitem == STACK_FLOATARRAY) {	/* <array>*<float value> */
     basicarray *lharray;
     float64 *base;
     int32 n, count;
@@ -3859,7 +3853,7 @@ static void eval_vpow(void) {
 */
 static void eval_vlsl(void) {
   stackitem lhitem, rhitem;
-  int32 lhint = 0, rhint = 0, val32;
+  int32 rhint = 0, val32;
   int64 lhint64 = 0, val64;
   rhitem = GET_TOPITEM;
   switch(rhitem) {
@@ -3879,15 +3873,17 @@ static void eval_vlsl(void) {
   rhint %=256;
   while (rhint < 0) rhint += 256;
   lhitem = GET_TOPITEM;	/* Branch according to type of left-hand operand */
-  if (lhitem == STACK_INT) {
-    lhint = pop_int();
-    val32 = lhint << rhint;
-    val64 = (int64)lhint << rhint;
-    if ((rhint < 64) && (val32 == val64)) {
-      push_int(val32);
-    } else if (rhint < 64) {
-      push_int64(val64);
-    } else push_int(0);
+  if (lhitem == STACK_INT) {	/* Update value on stack in place if the result fits */
+    if (rhint < 64) {
+      val64 = (int64)GET_TOPINT << rhint;
+      val32 = (int32)val64;
+      if (val32 == val64)
+        SET_TOPINT(val32);
+      else {
+        pop_int();
+        push_int64(val64);
+      }
+    } else SET_TOPINT(0);
   } else if (lhitem == STACK_INT64 || lhitem == STACK_FLOAT) {
     lhint64 = lhitem == STACK_INT64 ? pop_int64() : TOINT64(pop_float());
     if (rhint < 64) {
@@ -3925,11 +3921,11 @@ static void eval_vlsr(void) {
   }
   rhuint %= 256;
   lhitem = GET_TOPITEM;
-  if (lhitem == STACK_INT) {	/* Branch according to type of left-hand operand */
-    lhuint = pop_int();
+  if (lhitem == STACK_INT) {	/* Branch according to type of left-hand operand - Update value in place */
+    lhuint = GET_TOPINT;
     if (rhuint < 32) {
-      push_int((lhuint >> rhuint) & 0x7FFFFFFF);
-    } else push_int(0);
+      SET_TOPINT((lhuint >> rhuint) & 0x7FFFFFFF);
+    } else SET_TOPINT(0);
   }
   else if (lhitem == STACK_INT64 || lhitem == STACK_FLOAT) {
     lhuint64 = lhitem == STACK_INT64 ? pop_int64() : TOINT64(pop_float());
@@ -3965,11 +3961,11 @@ static void eval_vasr(void) {
   rhint %=256;
   while (rhint < 0) rhint += 256;
   lhitem = GET_TOPITEM;	/* Branch according to type of left-hand operand */
-  if (lhitem == STACK_INT) {
-    lhint = pop_int();
+  if (lhitem == STACK_INT) {	/* Update value on stack in place */
+    lhint = GET_TOPINT;
     if (rhint < 32) {
-      push_int((lhint >> rhint) | (lhint & 0x80000000));
-    } else push_int(0);
+      SET_TOPINT((lhint >> rhint) | (lhint & 0x80000000));
+    } else SET_TOPINT(0);
   } else if (lhitem == STACK_INT64 || lhitem == STACK_FLOAT) {
     lhint64 = lhitem == STACK_INT64 ? pop_int64() : TOINT64(pop_float());
     if (rhint < 64) {
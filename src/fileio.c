@@ -27,6 +27,7 @@
 ** provided by the underlying operating system.
 */
 
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
@@ -44,6 +45,127 @@
 /* Floating point number format */
 enum {XMIXED_ENDIAN, XLITTLE_ENDIAN, XBIG_ENDIAN, XBIG_MIXED_ENDIAN} double_type;
 
+/*
+** 'float_mask' returns the byte offset mask that converts a floating
+** point value between the machine's byte order and little endian order.
+** Byte 'n' of a little endian value is byte 'n^mask' of the value in
+** memory
+*/
+static int32 float_mask(void) {
+  switch (double_type) {
+  case XMIXED_ENDIAN:
+    return 4;
+  case XBIG_ENDIAN:
+    return 7;
+  case XBIG_MIXED_ENDIAN:
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+/*
+** 'print_elements' and 'get_elements' write or read the contents of
+** array 'ap' one element at a time using the ordinary file functions.
+** If 'raw' is FALSE the values are in the tagged format used by 'PRINT#'.
+** If it is TRUE numbers are untagged binary values, least significant
+** byte first, and strings are lines of text as 'BPUT#' writes them.
+** These are used under RISC OS and for string arrays and network
+** connections elsewhere
+*/
+static void print_elements(int32 handle, int32 vartype, basicarray *ap, boolean raw) {
+  int32 n, k, mask;
+  byte *source;
+  mask = float_mask();
+  for (n=0; n<ap->arrsize; n++) {
+    switch (vartype) {
+    case VAR_INTARRAY:
+      if (raw)
+        for (k=0; k<32; k+=8) fileio_bput(handle, ap->arraystart.intbase[n]>>k);
+      else {
+        fileio_printint(handle, ap->arraystart.intbase[n]);
+      }
+      break;
+    case VAR_INT64ARRAY:
+      if (raw)
+        for (k=0; k<64; k+=8) fileio_bput(handle, ap->arraystart.int64base[n]>>k);
+      else {
+        fileio_printint64(handle, ap->arraystart.int64base[n]);
+      }
+      break;
+    case VAR_FLOATARRAY:
+      if (raw) {
+        source = CAST(&ap->arraystart.floatbase[n], byte *);
+        for (k=0; k<sizeof(float64); k++) fileio_bput(handle, source[k^mask]);
+      }
+      else {
+        fileio_printfloat(handle, ap->arraystart.floatbase[n]);
+      }
+      break;
+    case VAR_STRARRAY:
+      if (raw) {
+        fileio_bputstr(handle, ap->arraystart.stringbase[n].stringaddr, ap->arraystart.stringbase[n].stringlen);
+        fileio_bput(handle, asc_LF);
+      }
+      else {
+        fileio_printstring(handle, ap->arraystart.stringbase[n].stringaddr, ap->arraystart.stringbase[n].stringlen);
+      }
+    }
+  }
+}
+
+static void get_elements(int32 handle, int32 vartype, basicarray *ap, boolean raw) {
+  int32 n, k, intvalue, length, mask;
+  int64 int64value;
+  float64 floatvalue;
+  boolean isint;
+  char *cp;
+  mask = float_mask();
+  for (n=0; n<ap->arrsize; n++) {
+    switch (vartype) {
+    case VAR_INTARRAY:
+      if (raw) {
+        intvalue = 0;
+        for (k=0; k<32; k+=8) intvalue |= fileio_bget(handle)<<k;
+      }
+      else {
+        fileio_getnumber(handle, &isint, &int64value, &floatvalue);
+        intvalue = isint ? INT64TO32(int64value) : TOINT(floatvalue);
+      }
+      ap->arraystart.intbase[n] = intvalue;
+      break;
+    case VAR_INT64ARRAY:
+      if (raw) {
+        int64 value = 0;
+        for (k=0; k<64; k+=8) value |= CAST(fileio_bget(handle), int64)<<k;
+        ap->arraystart.int64base[n] = value;
+      }
+      else {
+        fileio_getnumber(handle, &isint, &int64value, &floatvalue);
+        ap->arraystart.int64base[n] = isint ? int64value : TOINT64(floatvalue);
+      }
+      break;
+    case VAR_FLOATARRAY:
+      if (raw) {
+        cp = CAST(&ap->arraystart.floatbase[n], char *);
+        for (k=0; k<sizeof(float64); k++) cp[k^mask] = fileio_bget(handle);
+      }
+      else {
+        fileio_getnumber(handle, &isint, &int64value, &floatvalue);
+        ap->arraystart.floatbase[n] = isint ? TOFLOAT(int64value) : floatvalue;
+      }
+      break;
+    case VAR_STRARRAY:
+      length = raw ? fileio_getdol(handle, basicvars.stringwork) : fileio_getstring(handle, basicvars.stringwork);
+      free_string(ap->arraystart.stringbase[n]);
+      cp = alloc_string(length);
+      if (length>0) memmove(cp, basicvars.stringwork, length);
+      ap->arraystart.stringbase[n].stringlen = length;
+      ap->arraystart.stringbase[n].stringaddr = cp;
+    }
+  }
+}
+
 #ifdef TARGET_RISCOS
 
 /* ================================================================= */
@@ -185,11 +307,21 @@ int32 fileio_getdol(int32 handle, char *buffer) {
   return length;
 }
 
+/*
+** 'fileio_getline' reads a line of text from a file. It returns a
+** pointer to the text and sets 'length' to its length
+*/
+char *fileio_getline(int32 handle, int32 *length) {
+  *length = fileio_getdol(handle, basicvars.stringwork);
+  return basicvars.stringwork;
+}
+
 /*
 ** 'fileio_getnumber' reads a binary number from the file with
 ** handle 'handle'. It stores the result at the address given
 ** by 'ip' if integer or at 'fp' is floating point. 'isint' is
-** set to TRUE if the value is an integer.
+** set to TRUE if the value is an integer. Both 32-bit and 64-bit
+** integers are returned as 64-bit values.
 **
 ** Note that integers are stored in big endian format in the file
 ** by PRINT#. Floating point values are written in the byte order
@@ -201,20 +333,21 @@ int32 fileio_getdol(int32 handle, char *buffer) {
 ** floating point values produced by this program or basic64.
 ** It does not handle numbers in Acorn's five byte format.
 */
-void fileio_getnumber(int32 handle, boolean *isint, int32 *ip, float64 *fp) {
-  int32 n, marker;
+void fileio_getnumber(int32 handle, boolean *isint, int64 *ip, float64 *fp) {
+  int32 n, marker, value;
   char temp[sizeof(float64)];
   marker = read(handle);
   switch (marker) {
   case PRINT_INT:
     for (n=1; n<=sizeof(int32); n++) temp[sizeof(int32)-n] = read(handle);
-    memmove(ip, temp, sizeof(int32));
+    memmove(&value, temp, sizeof(int32));
+    *ip = value;
     *isint = TRUE;
     break;
   case PRINT_INT64:
     for (n=1; n<=sizeof(int64); n++) temp[sizeof(int64)-n] = read(handle);
     memmove(ip, temp, sizeof(int64));
-    *isint = 2;
+    *isint = TRUE;
     break;
   case PRINT_FLOAT:
     for (n=0; n<sizeof(float64); n++) temp[n] = read(handle);
@@ -428,6 +561,26 @@ void fileio_shutdown(void) {
 void init_fileio(void) {
 }
 
+/*
+** 'fileio_printarray' writes the contents of array 'ap' of type 'vartype'
+** to a file. If 'raw' is FALSE the elements are written in the same tagged
+** format as 'PRINT#'. If it is TRUE numeric elements are written as an
+** untagged block in little endian byte order and strings are written as
+** lines of text, as 'BPUT#' does
+*/
+void fileio_printarray(int32 handle, int32 vartype, basicarray *ap, boolean raw) {
+  print_elements(handle, vartype, ap, raw);
+}
+
+/*
+** 'fileio_getarray' reads the contents of array 'ap' of type 'vartype'
+** from a file. The data are expected to be in the format written by
+** 'fileio_printarray'
+*/
+void fileio_getarray(int32 handle, int32 vartype, basicarray *ap, boolean raw) {
+  get_elements(handle, vartype, ap, raw);
+}
+
 #else
 
 /* ================================================================== */
@@ -467,10 +620,20 @@ typedef struct {
   eofstate eofstatus;		/* Current end-of-file status */
   boolean lastwaswrite;		/* TRUE if the last operation on a file was a write */
   int nethandle;		/* network handle */
+  char *linebuf;		/* Read-ahead buffer used by 'GET$#' or NIL */
+  int32 linestart;		/* Offset of first unused byte in 'linebuf' */
+  int32 lineend;		/* Offset of end of data in 'linebuf' */
 } fileblock;
 
 static fileblock fileinfo [MAXFILES];
 
+/*
+** 'LINEBUFSIZE' is the size of the read-ahead buffer used when reading
+** lines of text from a file. It has to be able to hold the longest
+** possible line plus its line end
+*/
+#define LINEBUFSIZE (4*MAXSTRING)
+
 /*
 ** 'isapath' returns TRUE if the file name passed to it is a pathname, that
 ** is, contains directories as well as a file name, and FALSE if it consists
@@ -484,15 +647,30 @@ boolean isapath(char *name) {
 }
 
 /*
-** 'map_handle' maps a Basic-style file handle to the corresponding entry
+** 'check_handle' maps a Basic-style file handle to the corresponding entry
 ** in the 'fileinfo' table and checks that the handle is valid
 */
-static int32 map_handle(int32 handle) {
+static int32 check_handle(int32 handle) {
   handle = FIRSTHANDLE-handle;
   if (handle<0 || handle>=MAXFILES || fileinfo[handle].filetype==CLOSED) error(ERR_BADHANDLE);
   return handle;
 }
 
+/*
+** 'map_handle' is the same as 'check_handle' except that it also gives
+** back any data read ahead by 'fileio_getline' and not used so that
+** the file pointer is where the Basic program expects it to be before
+** the file is accessed in any other way
+*/
+static int32 map_handle(int32 handle) {
+  handle = check_handle(handle);
+  if (fileinfo[handle].linestart<fileinfo[handle].lineend) {
+    fseek(fileinfo[handle].stream, fileinfo[handle].linestart-fileinfo[handle].lineend, SEEK_CUR);
+    fileinfo[handle].linestart = fileinfo[handle].lineend = 0;
+  }
+  return handle;
+}
+
 /*
 ** 'fileio_openin' opens a file for input
 */
@@ -593,6 +771,9 @@ static void close_file(int32 handle) {
     fileinfo[handle].stream = NIL;
     fileinfo[handle].filetype = CLOSED;
     fileinfo[handle].lastwaswrite = FALSE;
+    free(fileinfo[handle].linebuf);
+    fileinfo[handle].linebuf = NIL;
+    fileinfo[handle].linestart = fileinfo[handle].lineend = 0;
 #ifndef NONET
   }
 #endif
@@ -663,11 +844,87 @@ int32 fileio_bget(int32 handle) {
   return ch;
 }
 
+/*
+** 'fileio_getline' reads a line of text from a file. It returns a
+** pointer to the text and sets 'length' to its length. The text is
+** only valid until the next file operation. Any terminating line end
+** characters are removed. 'linefeed', 'carriage return' and 'carriage
+** return-linefeed' style line ends are recognised. Lines longer than
+** MAXSTRING characters are returned in MAXSTRING character pieces.
+**
+** The file is read in large blocks into a buffer attached to the file
+** and lines are picked out of that. Data that has been read ahead is
+** given back by 'map_handle' if the file is then used in any other way.
+** Files where the file pointer cannot be moved, for example, pipes, are
+** read using 'fgets' instead
+*/
+char *fileio_getline(int32 handle, int32 *length) {
+  fileblock *fp;
+  char *p, *eol;
+  int32 avail, scan, count;
+  boolean ateof;
+
+  if (handle==0) error(ERR_BADHANDLE);
+  handle = check_handle(handle);
+  fp = &fileinfo[handle];
+  if (fp->eofstatus!=OKAY) {	/* If EOF is pending or EOF, flag an error */
+    fp->eofstatus = ATEOF;
+    error(ERR_HITEOF);
+  }
+  if (fp->lastwaswrite) {		/* Ensure everything has been written to disk first */
+    fflush(fp->stream);
+    fp->lastwaswrite = FALSE;
+  }
+  if (fp->linebuf==NIL) {
+    if (ftell(fp->stream)!=-1) fp->linebuf = malloc(LINEBUFSIZE);
+    if (fp->linebuf==NIL) {	/* Cannot read ahead - Use 'fgets' */
+      p = fgets(basicvars.stringwork, MAXSTRING, fp->stream);
+      if (p==NIL) error(ERR_CANTREAD);	/* Read failed utterly */
+      count = strlen(p);
+      if (count>0 && p[count-1]==asc_LF) count--;	/* Got a 'linefeed' at the end of the line */
+      if (count>0 && p[count-1]==asc_CR) count--;	/* Got a 'carriage return-linefeed' pair */
+      *length = count;
+      return p;
+    }
+    fp->linestart = fp->lineend = 0;
+  }
+  ateof = FALSE;
+  do {
+    p = fp->linebuf+fp->linestart;
+    avail = fp->lineend-fp->linestart;
+    scan = avail<MAXSTRING ? avail : MAXSTRING;
+    eol = memchr(p, asc_LF, scan);
+    if (eol!=NIL) scan = eol-p;
+    if (scan>0) {	/* Look for a 'carriage return' before the 'linefeed' */
+      char *cr = memchr(p, asc_CR, scan);
+      if (cr!=NIL) eol = cr;
+    }
+    if (eol!=NIL && (*eol==asc_LF || eol-p+1<avail || ateof)) {	/* Found a complete line */
+      count = eol-p;
+      fp->linestart+=count+1;
+      if (*eol==asc_CR && eol-p+1<avail && eol[1]==asc_LF) fp->linestart++;
+      *length = count;
+      return p;
+    }
+    if (eol==NIL && (avail>=MAXSTRING || (ateof && avail>0))) {	/* Over-long line or last line has no line end */
+      fp->linestart+=scan;
+      *length = scan;
+      return p;
+    }
+    if (ateof) error(ERR_CANTREAD);
+/* Move what is left to the start of the buffer and refill it */
+    if (avail>0 && fp->linestart>0) memmove(fp->linebuf, p, avail);
+    fp->linestart = 0;
+    fp->lineend = avail;
+    count = fread(fp->linebuf+avail, sizeof(char), LINEBUFSIZE-avail, fp->stream);
+    fp->lineend+=count;
+    ateof = count==0;
+  } while (TRUE);
+}
+
 /*
 ** 'fileio_getdol' reads a string from a file. It saves the text read at
-** 'buffer'. Any terminating line end characters are removed. Both
-** 'carriage return-linefeed' and 'linefeed' style line ends are recognised.
-** The function returns the number of characters read (minus line end
+** 'buffer' and returns the number of characters read (minus line end
 ** characters). Note that there is no check on the size of the buffer
 ** so it is up to the functions that call this one to ensure that the
 ** buffer is large enough to hold MAXSTRING (65536) characters.
@@ -675,25 +932,8 @@ int32 fileio_bget(int32 handle) {
 int32 fileio_getdol(int32 handle, char *buffer) {
   char *p;
   int32 length;
-
-  if (handle==0) error(ERR_BADHANDLE);
-  handle = map_handle(handle);
-  if (fileinfo[handle].eofstatus!=OKAY) {	/* If EOF is pending or EOF, flag an error */
-    fileinfo[handle].eofstatus = ATEOF;
-    error(ERR_HITEOF);
-  }
-  if (fileinfo[handle].lastwaswrite) {		/* Ensure everything has been written to disk first */
-    fflush(fileinfo[handle].stream);
-    fileinfo[handle].lastwaswrite = FALSE;
-  }
-  p = fgets(buffer, MAXSTRING, fileinfo[handle].stream);
-  if (p==NIL) error(ERR_CANTREAD);	/* Read failed utterly */
-  length = strlen(buffer);
-  p = buffer+length-1;	/* Point at line end character */
-  if (*p==asc_LF) {	/* Got a 'linefeed' at the end of the line */
-    length--;
-    if (length>0 && *(p-1)==asc_CR) length--;	/* Got a 'carriage return-linefeed' pair */
-  }
+  p = fileio_getline(handle, &length);
+  if (length>0 && p!=buffer) memmove(buffer, p, length);
   return length;
 }
 
@@ -708,7 +948,8 @@ static int32 read(FILE *handle) {
 ** 'fileio_getnumber' reads a binary number from the file with
 ** handle 'handle'. It stores the result at the address given
 ** by 'ip' if integer or at 'fp' is floating point. 'isint' is
-** set to TRUE if the value is an integer.
+** set to TRUE if the value is an integer. Both 32-bit and 64-bit
+** integers are returned as 64-bit values.
 **
 ** Note that integers are stored in big endian format in the file
 ** by PRINT#. Floating point values are written in the byte order
@@ -719,9 +960,9 @@ static int32 read(FILE *handle) {
 ** Darren Salt, along with the support for reading Acorn's five
 ** byte floating point format
 */
-void fileio_getnumber(int32 handle, boolean *isint, int32 *ip, float64 *fp) {
+void fileio_getnumber(int32 handle, boolean *isint, int64 *ip, float64 *fp) {
   FILE *stream;
-  int32 n, marker;
+  int32 n, marker, value;
   char temp[sizeof(float64)];
 
   if (handle==0) error(ERR_BADHANDLE);
@@ -738,8 +979,14 @@ void fileio_getnumber(int32 handle, boolean *isint, int32 *ip, float64 *fp) {
   marker = read(stream);
   switch (marker) {
   case PRINT_INT:
+    value = 0;
+    for (n=24; n>=0; n-=8) value |= read(stream) << n;
+    *ip = value;
+    *isint = TRUE;
+    break;
+  case PRINT_INT64:
     *ip = 0;
-    for (n=24; n>=0; n-=8) *ip |= read(stream) << n;
+    for (n=56; n>=0; n-=8) *ip |= CAST(read(stream), int64) << n;
     *isint = TRUE;
     break;
   case PRINT_FLOAT:
@@ -979,6 +1226,258 @@ void fileio_printstring(int32 handle, char *string, int32 length) {
   fileinfo[handle].lastwaswrite = TRUE;
 }
 
+/*
+** The following functions read and write whole numeric arrays. Rather
+** than going through the file a byte at a time, values are encoded into
+** or decoded from 'arraybuffer' and transferred in large blocks.
+** 'ARRAYSLACK' is more than the space one tagged value needs
+*/
+#define ARRAYBUFSIZE 65536
+#define ARRAYSLACK 16
+
+static byte arraybuffer[ARRAYBUFSIZE];
+
+/*
+** Byte offset masks that convert between the machine's byte order and
+** little endian order for raw array data. Byte 'n' of a little endian
+** value is byte 'n^mask' of the value in memory
+*/
+static int32 int32mask, int64mask, floatmask;
+
+/*
+** 'reorder_elements' rearranges the bytes of 'count' elements of size
+** 'size' at 'p' according to byte offset mask 'mask'
+*/
+static void reorder_elements(byte *p, int32 count, int32 size, int32 mask) {
+  int32 n, k;
+  byte temp[sizeof(float64)];
+  if (mask==0) return;
+  for (n=0; n<count; n++) {
+    memcpy(temp, p, size);
+    for (k=0; k<size; k++) p[k] = temp[k^mask];
+    p+=size;
+  }
+}
+
+/*
+** 'write_arraybuffer' writes the first 'count' bytes of the array buffer
+** to the file with table index 'handle'
+*/
+static void write_arraybuffer(int32 handle, int32 count) {
+  if (count==0) return;
+#ifndef NONET
+  if (fileinfo[handle].filetype==NETWORK) {
+    if (net_bputstr(fileinfo[handle].nethandle, CAST(arraybuffer, char *), count)) error(ERR_CANTWRITE);
+    return;
+  }
+#endif
+  if (fwrite(arraybuffer, sizeof(byte), count, fileinfo[handle].stream)!=count) error(ERR_CANTWRITE);
+}
+
+/*
+** 'fileio_printarray' writes the contents of array 'ap' of type 'vartype'
+** to a file. If 'raw' is FALSE the elements are written in the same tagged
+** format as 'PRINT#'. If it is TRUE numeric elements are written as an
+** untagged block in little endian byte order and strings are written as
+** lines of text, as 'BPUT#' does
+*/
+void fileio_printarray(int32 handle, int32 vartype, basicarray *ap, boolean raw) {
+  int32 n, k, count, size, mask, used;
+  byte *bp, *source;
+
+  if (vartype==VAR_STRARRAY) {	/* Strings are written one at a time */
+    print_elements(handle, vartype, ap, raw);
+    return;
+  }
+  if (handle==0) error(ERR_BADHANDLE);
+  handle = map_handle(handle);
+  if (fileinfo[handle].filetype==OPENIN) error(ERR_OPENIN);
+  fileinfo[handle].eofstatus = OKAY;
+  switch (vartype) {
+  case VAR_INTARRAY:
+    size = sizeof(int32);
+    mask = int32mask;
+    break;
+  case VAR_INT64ARRAY:
+    size = sizeof(int64);
+    mask = int64mask;
+    break;
+  default:
+    size = sizeof(float64);
+    mask = floatmask;
+  }
+  source = CAST(ap->arraystart.arraybase, byte *);
+  if (raw) {	/* Untagged little endian data */
+    if (mask==0 && fileinfo[handle].filetype!=NETWORK) {	/* Array can be written as it stands */
+      if (fwrite(source, size, ap->arrsize, fileinfo[handle].stream)!=ap->arrsize) error(ERR_CANTWRITE);
+    }
+    else {
+      for (n=0; n<ap->arrsize; n+=count) {
+        count = ap->arrsize-n;
+        if (count>ARRAYBUFSIZE/size) count = ARRAYBUFSIZE/size;
+        memcpy(arraybuffer, source+n*size, count*size);
+        reorder_elements(arraybuffer, count, size, mask);
+        write_arraybuffer(handle, count*size);
+      }
+    }
+    fileinfo[handle].lastwaswrite = TRUE;
+    return;
+  }
+/* Tagged values in the same format as 'fileio_printint' and so forth */
+  used = 0;
+  for (n=0; n<ap->arrsize; n++) {
+    if (used>ARRAYBUFSIZE-ARRAYSLACK) {
+      write_arraybuffer(handle, used);
+      used = 0;
+    }
+    bp = arraybuffer+used;
+    switch (vartype) {
+    case VAR_INTARRAY:
+      bp[0] = PRINT_INT;
+      for (k=1; k<=4; k++) bp[k] = ap->arraystart.intbase[n] >> (32-k*8);
+      used+=5;
+      break;
+    case VAR_INT64ARRAY:
+      bp[0] = PRINT_INT64;
+      for (k=1; k<=8; k++) bp[k] = ap->arraystart.int64base[n] >> (64-k*8);
+      used+=9;
+      break;
+    default:	/* Acorn byte order, which is little endian with the words swapped */
+      bp[0] = PRINT_FLOAT;
+      source = CAST(&ap->arraystart.floatbase[n], byte *);
+      for (k=0; k<sizeof(float64); k++) bp[k+1] = source[k^4^floatmask];
+      used+=9;
+    }
+  }
+  write_arraybuffer(handle, used);
+  fileinfo[handle].lastwaswrite = TRUE;
+}
+
+/*
+** 'fileio_getarray' reads the contents of array 'ap' of type 'vartype'
+** from a file. The data are expected to be in the format written by
+** 'fileio_printarray'. Tagged numbers are converted to the type of the
+** array as 'INPUT#' does. The file is read in large blocks and, in the
+** case of tagged data, the file pointer is moved back to the end of the
+** last value used afterwards
+*/
+void fileio_getarray(int32 handle, int32 vartype, basicarray *ap, boolean raw) {
+  FILE *stream;
+  int32 n, k, size, mask, avail, marker, intvalue = 0;
+  int64 int64value = 0;
+  float64 floatvalue = 0;
+  byte *bp, *dest;
+
+  if (vartype==VAR_STRARRAY) {	/* Strings are read one at a time */
+    get_elements(handle, vartype, ap, raw);
+    return;
+  }
+  if (handle==0) error(ERR_BADHANDLE);
+  handle = map_handle(handle);
+#ifndef NONET
+  if (fileinfo[handle].filetype==NETWORK) {
+    get_elements(FIRSTHANDLE-handle, vartype, ap, raw);
+    return;
+  }
+#endif
+  if (fileinfo[handle].eofstatus!=OKAY) {	/* If EOF is pending, flag an error */
+    fileinfo[handle].eofstatus = ATEOF;
+    error(ERR_HITEOF);
+  }
+  if (fileinfo[handle].lastwaswrite) {	/* Ensure everything has been written to disk first */
+    fflush(fileinfo[handle].stream);
+    fileinfo[handle].lastwaswrite = FALSE;
+  }
+  stream = fileinfo[handle].stream;
+  if (raw) {	/* Untagged little endian data. Read it straight into the array */
+    switch (vartype) {
+    case VAR_INTARRAY:
+      size = sizeof(int32);
+      mask = int32mask;
+      break;
+    case VAR_INT64ARRAY:
+      size = sizeof(int64);
+      mask = int64mask;
+      break;
+    default:
+      size = sizeof(float64);
+      mask = floatmask;
+    }
+    dest = CAST(ap->arraystart.arraybase, byte *);
+    n = fread(dest, size, ap->arrsize, stream);
+    reorder_elements(dest, n, size, mask);
+    if (n!=ap->arrsize) {
+      fileinfo[handle].eofstatus = ATEOF;
+      error(ERR_HITEOF);
+    }
+    return;
+  }
+  avail = 0;
+  bp = arraybuffer;
+  for (n=0; n<ap->arrsize; n++) {
+    if (avail<ARRAYSLACK && !feof(stream)) {	/* Top up the buffer */
+      memmove(arraybuffer, bp, avail);
+      bp = arraybuffer;
+      avail+=fread(arraybuffer+avail, sizeof(byte), ARRAYBUFSIZE-avail, stream);
+    }
+    if (avail==0) error(ERR_CANTREAD);
+    marker = *bp;
+    switch (marker) {
+    case PRINT_INT:
+      if (avail<5) error(ERR_CANTREAD);
+      intvalue = 0;
+      for (k=1; k<=4; k++) intvalue = (intvalue << 8) | bp[k];
+      bp+=5;
+      avail-=5;
+      break;
+    case PRINT_INT64:
+      if (avail<9) error(ERR_CANTREAD);
+      int64value = 0;
+      for (k=1; k<=8; k++) int64value = (int64value << 8) | bp[k];
+      bp+=9;
+      avail-=9;
+      break;
+    case PRINT_FLOAT:
+      if (avail<9) error(ERR_CANTREAD);
+      dest = CAST(&floatvalue, byte *);
+      for (k=0; k<sizeof(float64); k++) dest[k^4^floatmask] = bp[k+1];
+      bp+=9;
+      avail-=9;
+      break;
+    case PRINT_FLOAT5: {	/* Acorn's five byte format */
+      int32 exponent, mantissa;
+      if (avail<6) error(ERR_CANTREAD);
+      mantissa = bp[1] | (bp[2] << 8) | (bp[3] << 16) | (bp[4] << 24);
+      exponent = bp[5];
+      if (exponent || mantissa) {
+        floatvalue = ((mantissa & 0x7FFFFFFF) / 4294967296.0 + 0.5)
+                     * pow (2, exponent - 0x80)
+                     * (mantissa < 0 ? -1 : 1);
+      } else {
+        floatvalue = 0;
+      }
+      marker = PRINT_FLOAT;
+      bp+=6;
+      avail-=6;
+      break;
+    }
+    default:
+      error(ERR_TYPENUM);
+    }
+    switch (vartype) {
+    case VAR_INTARRAY:
+      ap->arraystart.intbase[n] = marker==PRINT_INT ? intvalue : (marker==PRINT_INT64 ? INT64TO32(int64value) : TOINT(floatvalue));
+      break;
+    case VAR_INT64ARRAY:
+      ap->arraystart.int64base[n] = marker==PRINT_INT ? intvalue : (marker==PRINT_INT64 ? int64value : TOINT64(floatvalue));
+      break;
+    default:
+      ap->arraystart.floatbase[n] = marker==PRINT_INT ? TOFLOAT(intvalue) : (marker==PRINT_INT64 ? TOFLOAT(int64value) : floatvalue);
+    }
+  }
+  if (avail>0) fseek(stream, -CAST(avail, long), SEEK_CUR);	/* Give back the bytes not used */
+}
+
 /*
 ** 'fileio_setptr' is used to set the current file pointer
 */
@@ -999,10 +1498,10 @@ int32 fileio_getptr(int32 handle) {
   int32 result;
 
   if (handle==0) error(ERR_BADHANDLE);
-  handle = map_handle(handle);
+  handle = check_handle(handle);
   result = TOINT(ftell(fileinfo[handle].stream));
   if (result==-1) error(ERR_GETPTRFAIL);	/* File pointer cannot be read */
-  return result;
+  return result-(fileinfo[handle].lineend-fileinfo[handle].linestart);	/* Allow for data read ahead */
 }
 
 /*
@@ -1052,12 +1551,13 @@ int32 fileio_eof(int32 handle) {
 #else
   if (handle==0) error(ERR_BADHANDLE);
 #endif
-  handle = map_handle(handle);
+  handle = check_handle(handle);
 #ifndef NONET
   if (fileinfo[handle].filetype == NETWORK) {
     return net_eof(fileinfo[handle].nethandle);
   } else {
 #endif
+  if (fileinfo[handle].linestart<fileinfo[handle].lineend) return FALSE;	/* There is data read ahead */
   stream = fileinfo[handle].stream;
   position = ftell(stream);
   if (position==-1) return feof(stream) ? TRUE : FALSE;
@@ -1119,6 +1619,21 @@ static void find_floatformat(void) {
   }
 }
 
+/*
+** 'find_byteorder' sets up the byte offset masks used to convert raw
+** array data to and from little endian order
+*/
+static void find_byteorder(void) {
+  union {
+    int32 temp1;
+    byte temp2[sizeof(int32)];
+  } value;
+  value.temp1 = 1;
+  int32mask = value.temp2[0]==1 ? 0 : 3;
+  int64mask = int32mask==0 ? 0 : 7;
+  floatmask = float_mask();
+}
+
 /*
 ** 'init_fileio' is called to initialise the file handling
 */
@@ -1128,8 +1643,11 @@ void init_fileio(void) {
     fileinfo[n].stream = NIL;
     fileinfo[n].filetype = CLOSED;
     fileinfo[n].eofstatus = ATEOF;
+    fileinfo[n].linebuf = NIL;
+    fileinfo[n].linestart = fileinfo[n].lineend = 0;
   }
   find_floatformat();
+  find_byteorder();
 }
 
 #endif
@@ -25,6 +25,9 @@
 #ifndef __fileio_h
 #define __fileio_h
 
+#include "common.h"
+#include "basicdefs.h"
+
 extern boolean isapath(char *);
 
 extern void init_fileio(void);
@@ -34,7 +37,8 @@ extern int32 fileio_openup(char *, int32);
 extern void fileio_close(int32);
 extern int32 fileio_bget(int32);
 extern int32 fileio_getdol(int32, char *);
-extern void fileio_getnumber(int32, boolean *, int32 *, float64 *);
+extern char *fileio_getline(int32, int32 *);
+extern void fileio_getnumber(int32, boolean *, int64 *, float64 *);
 extern int32 fileio_getstring(int32, char *);
 extern void fileio_bput(int32, int32);
 extern void fileio_bputstr(int32, char *, int32);
@@ -42,6 +46,8 @@ extern void fileio_printint(int32, int32);
 extern void fileio_printint64(int32, int64);
 extern void fileio_printfloat(int32, float64);
 extern void fileio_printstring(int32, char *, int32);
+extern void fileio_printarray(int32, int32, basicarray *, boolean);
+extern void fileio_getarray(int32, int32, basicarray *, boolean);
 extern int32 fileio_eof(int32);
 extern int32 fileio_getptr(int32);
 extern void fileio_setptr(int32, int32);
@@ -51,6 +51,7 @@
 #include "miscprocs.h"
 #include "fileio.h"
 #include "functions.h"
+#include "lvalue.h"
 
 
 /* #define DEBUG */
@@ -81,8 +82,14 @@
 
 #define STRFORMAT 0xA0A			/* Default format used by function STR$ */
 
+#define RND_BASIC 0			/* RND uses the BASIC II pseudo-random number generator */
+#define RND_XOSHIRO 1			/* RND uses the xoshiro256** generator */
+
 static int32 lastrandom;		/* 32-bit pseudo-random number generator value */
 static int32 randomoverflow;		/* 1-bit overflow from pseudo-random number generator */
+static int32 randomgenerator;		/* Generator used by RND: RND_BASIC or RND_XOSHIRO */
+static uint64 xoshiro[4];		/* State of the xoshiro256** generator */
+static uint64 lastxoshiro;		/* Last value produced by the xoshiro256** generator */
 static float64 floatvalue;		/* Temporary for holding floating point values */
 
 /*
@@ -139,6 +146,39 @@ static void fn_filepath(void) {
   push_strtemp(length, cp);
 }
 
+/*
+** 'push_substring' pushes the 'length' characters starting at offset
+** 'start' of the string 'descriptor' on to the Basic stack. If the
+** string is a reference to an existing string, the result is a reference
+** to the part of it that is wanted and no copy is made. Anything that
+** keeps a 'STACK_STRING' item already takes a copy of it. If the string
+** is a temporary string, the part wanted is moved to the start of it if
+** the substring uses the same size of memory block. The block is not cut
+** down otherwise, as that fragments the string heap
+*/
+static void push_substring(stackitem stringtype, basicstring descriptor, int32 start, int32 length) {
+  if (stringtype == STACK_STRING) {
+    descriptor.stringaddr+=start;
+    descriptor.stringlen = length;
+    push_string(descriptor);
+  }
+  else if (length == 1) {	/* Single character strings do not need to go on the heap */
+    basicstring charstring = char_string(descriptor.stringaddr[start]);
+    free_string(descriptor);
+    push_string(charstring);
+  }
+  else if (string_fits(descriptor.stringlen, length)) {
+    if (start>0) memmove(descriptor.stringaddr, descriptor.stringaddr+start, length);
+    push_strtemp(length, descriptor.stringaddr);
+  }
+  else {
+    char *cp = alloc_string(length);
+    memmove(cp, descriptor.stringaddr+start, length);
+    free_string(descriptor);
+    push_strtemp(length, cp);
+  }
+}
+
 /*
 ** 'fn_left' handles the 'LEFT$(' function
 */
@@ -146,7 +186,6 @@ static void fn_left(void) {
   stackitem stringtype;
   basicstring descriptor;
   int32 length;
-  char *cp;
   expression();		/* Fetch the string */
   stringtype = GET_TOPITEM;
   if (stringtype != STACK_STRING && stringtype != STACK_STRTEMP) error(ERR_TYPESTR);
@@ -155,43 +194,18 @@ static void fn_left(void) {
     length = eval_integer();
     if (*basicvars.current != ')') error(ERR_RPMISS);	/* ')' missing */
     basicvars.current++;
-    if (length<0)
-      return;	/* Do nothing if required length is negative, that is, return whole string */
-    else if (length == 0) {		/* Don't want anything from the string */
-      descriptor = pop_string();
-      if (stringtype == STACK_STRTEMP) free_string(descriptor);
-      cp = alloc_string(0);		/* Allocate a null string */
-      push_strtemp(0, cp);
-    }
-    else {
-      descriptor = pop_string();
-      if (length>=descriptor.stringlen)	/* Substring length exceeds that of original string */
-        push_string(descriptor);	/* So put the old string back on the stack */
-      else {
-        cp = alloc_string(length);
-        memcpy(cp, descriptor.stringaddr, length);
-        push_strtemp(length, cp);
-        if (stringtype == STACK_STRTEMP) free_string(descriptor);
-      }
-    }
+    if (length<0) return;	/* Do nothing if required length is negative, that is, return whole string */
+    descriptor = pop_string();
+    if (length>descriptor.stringlen) length = descriptor.stringlen;	/* Substring length exceeds that of original string */
   }
   else {	/* Return original string with the last character sawn off */
     if (*basicvars.current != ')') error(ERR_RPMISS);	/* ')' missing */
     basicvars.current++;	/* Skip past the ')' */
     descriptor = pop_string();
     length = descriptor.stringlen-1;
-    if (length<=0) {
-      if (stringtype == STACK_STRTEMP) free_string(descriptor);
-      cp = alloc_string(0);		/* Allocate a null string */
-      push_strtemp(0, cp);
-    }
-    else {	/* Create a new string of the required length */
-      cp = alloc_string(length);
-      memmove(cp, descriptor.stringaddr, length);
-      push_strtemp(length, cp);
-      if (stringtype == STACK_STRTEMP) free_string(descriptor);
-    }
+    if (length<0) length = 0;
   }
+  push_substring(stringtype, descriptor, 0, length);
 }
 
 /*
@@ -210,7 +224,6 @@ static void fn_mid(void) {
   stackitem stringtype;
   basicstring descriptor;
   int32 start, length;
-  char *cp;
   expression();		/* Fetch the string */
   stringtype = GET_TOPITEM;
   if (stringtype != STACK_STRING && stringtype != STACK_STRTEMP) error(ERR_TYPESTR);
@@ -228,22 +241,12 @@ static void fn_mid(void) {
   if (*basicvars.current != ')') error(ERR_RPMISS);	/* ')' missing */
   basicvars.current++;
   descriptor = pop_string();
-  if (length == 0 || start<0 || start>descriptor.stringlen) {	/* Don't want anything from the string */
-    if (stringtype == STACK_STRTEMP) free_string(descriptor);
-    cp = alloc_string(0);		/* Allocate a null string */
-    push_strtemp(0, cp);
-  }
+  if (length == 0 || start<0 || start>descriptor.stringlen)	/* Don't want anything from the string */
+    push_substring(stringtype, descriptor, 0, 0);
   else {	/* Want only some of the original string */
     if (start>0) start-=1;	/* Turn start position into an offset from zero */
-    if (start == 0 && length>=descriptor.stringlen)	/* Substring is entire string */
-      push_string(descriptor);	/* So put the old string back on the stack */
-    else {
-      if (start+length>descriptor.stringlen) length = descriptor.stringlen-start;
-      cp = alloc_string(length);
-      memcpy(cp, descriptor.stringaddr+start, length);
-      push_strtemp(length, cp);
-      if (stringtype == STACK_STRTEMP) free_string(descriptor);
-    }
+    if (length>descriptor.stringlen-start) length = descriptor.stringlen-start;
+    push_substring(stringtype, descriptor, start, length);
   }
 }
 
@@ -272,7 +275,6 @@ static void fn_right(void) {
   stackitem stringtype;
   basicstring descriptor;
   int32 length;
-  char *cp;
   expression();		/* Fetch the string */
   stringtype = GET_TOPITEM;
   if (stringtype != STACK_STRING && stringtype != STACK_STRTEMP) error(ERR_TYPESTR);
@@ -281,37 +283,16 @@ static void fn_right(void) {
     length = eval_integer();
     if (*basicvars.current != ')') error(ERR_RPMISS);	/* ')' missing */
     basicvars.current++;
-    if (length<=0) {	/* Do not want anything from string */
-      descriptor = pop_string();
-      if (stringtype == STACK_STRTEMP) free_string(descriptor);
-      cp = alloc_string(0);		/* Allocate a null string */
-      push_strtemp(0, cp);
-    }
-    else {
-      descriptor = pop_string();
-      if (length>=descriptor.stringlen)	/* Substring length exceeds that of original string */
-        push_string(descriptor);	/* So put the old string back on the stack */
-      else {
-        cp = alloc_string(length);
-        memcpy(cp, descriptor.stringaddr+descriptor.stringlen-length, length);
-        push_strtemp(length, cp);
-        if (stringtype == STACK_STRTEMP) free_string(descriptor);
-      }
-    }
+    if (length<0) length = 0;	/* Do not want anything from string */
   }
   else {	/* Return only the last character */
     if (*basicvars.current != ')') error(ERR_RPMISS);	/* ')' missing */
     basicvars.current++;	/* Skip past the ')' */
-    descriptor = pop_string();
-    if (descriptor.stringlen == 0)
-      push_string(descriptor);	/* String length is zero - Just put null string back on stack */
-    else {	/* Create a new single character string */
-      cp = alloc_string(1);
-      *cp = *(descriptor.stringaddr+descriptor.stringlen-1);
-      push_strtemp(1, cp);
-      if (stringtype == STACK_STRTEMP) free_string(descriptor);
-    }
+    length = 1;
   }
+  descriptor = pop_string();
+  if (length>descriptor.stringlen) length = descriptor.stringlen;	/* Substring length exceeds that of original string */
+  push_substring(stringtype, descriptor, descriptor.stringlen-length, length);
 }
 
 /*
@@ -338,9 +319,390 @@ static void fn_timedol(void) {
   push_strtemp(length, cp);
 }
 
+/*
+** 'ISNUMARRAY' is TRUE if the Basic stack entry type 'x' is a numeric
+** array or temporary array
+*/
+#define ISNUMARRAY(x) ((x) >= STACK_INTARRAY && (x) <= STACK_FATEMP)
+
+/*
+** 'floatarray_arg' is used by the mathematical functions that accept a
+** whole array as their argument, for example, 'SQR(a())'. The array on
+** top of the Basic stack, of type 'arraytype', is replaced by a
+** temporary floating point array holding the values of its elements.
+** The function returns a pointer to the first element and the number
+** of elements in 'count'. The caller then works on the elements in
+** place. A temporary floating point array is used as it stands and
+** temporary integer arrays are converted where they are
+*/
+static float64 *floatarray_arg(stackitem arraytype, int32 *count) {
+  basicarray descriptor;
+  float64 *base;
+  int32 n;
+  if (arraytype == STACK_FATEMP) {
+    descriptor = pop_arraytemp();
+  } else if (arraytype == STACK_IATEMP || arraytype == STACK_I64ATEMP) {
+    descriptor = pop_arraytemp();
+    free_stackmem();	/* Elements are left where they are until they are converted */
+    base = alloc_stackmem(descriptor.arrsize*sizeof(float64));
+    if (base == NIL) error(ERR_NOROOM);
+    if (arraytype == STACK_IATEMP) {
+/*
+** Move the integers to the start of the new block then widen them
+** working from the end. Converting element n overwrites integers
+** 2n and 2n+1, which have already been dealt with
+*/
+      int32 *ip = CAST(base, int32 *);
+      memmove(ip, descriptor.arraystart.intbase, descriptor.arrsize*sizeof(int32));
+      for (n = descriptor.arrsize-1; n >= 0; n--) base[n] = TOFLOAT(ip[n]);
+    } else {	/* 64-bit integers are the same size, so they are converted in place */
+      int64 *ip = CAST(base, int64 *);
+      memmove(ip, descriptor.arraystart.int64base, descriptor.arrsize*sizeof(int64));
+      for (n = 0; n < descriptor.arrsize; n++) base[n] = TOFLOAT(ip[n]);
+    }
+    descriptor.arraystart.floatbase = base;
+  } else {	/* Array is a Basic array - Copy it to a temporary array */
+    basicarray *ap = pop_array();
+    if (ap == NIL) error(ERR_NODIMS, "(");
+    descriptor = *ap;
+    base = alloc_stackmem(descriptor.arrsize*sizeof(float64));
+    if (base == NIL) error(ERR_NOROOM);
+    if (arraytype == STACK_INTARRAY) {
+      for (n = 0; n < descriptor.arrsize; n++) base[n] = TOFLOAT(ap->arraystart.intbase[n]);
+    } else if (arraytype == STACK_INT64ARRAY) {
+      for (n = 0; n < descriptor.arrsize; n++) base[n] = TOFLOAT(ap->arraystart.int64base[n]);
+    } else {
+      memmove(base, ap->arraystart.floatbase, descriptor.arrsize*sizeof(float64));
+    }
+    descriptor.arraystart.floatbase = base;
+  }
+  push_arraytemp(&descriptor, VAR_FLOAT);
+  *count = descriptor.arrsize;
+  return descriptor.arraystart.floatbase;
+}
+
+/*
+** 'abs_intarray' deals with 'ABS' when its argument is an array of
+** 32-bit or 64-bit integers, 'arraytype'. The result is a temporary
+** array of the same type. The absolute values are calculated in place
+** if the array is a temporary one
+*/
+static void abs_intarray(stackitem arraytype) {
+  basicarray descriptor, *ap;
+  int32 n;
+  if (arraytype == STACK_IATEMP || arraytype == STACK_I64ATEMP) {
+    descriptor = pop_arraytemp();
+    ap = &descriptor;
+  } else {
+    ap = pop_array();
+    if (ap == NIL) error(ERR_NODIMS, "(");
+    descriptor = *ap;
+  }
+  if (arraytype == STACK_INTARRAY || arraytype == STACK_IATEMP) {
+    int32 *srce = ap->arraystart.intbase, *base = srce;
+    if (arraytype == STACK_INTARRAY) base = alloc_stackmem(descriptor.arrsize*sizeof(int32));
+    if (base == NIL) error(ERR_NOROOM);
+    for (n = 0; n < descriptor.arrsize; n++) base[n] = abs(srce[n]);
+    descriptor.arraystart.intbase = base;
+    push_arraytemp(&descriptor, VAR_INTWORD);
+  } else {
+    int64 *srce = ap->arraystart.int64base, *base = srce;
+    if (arraytype == STACK_INT64ARRAY) base = alloc_stackmem(descriptor.arrsize*sizeof(int64));
+    if (base == NIL) error(ERR_NOROOM);
+    for (n = 0; n < descriptor.arrsize; n++) base[n] = llabs(srce[n]);
+    descriptor.arraystart.int64base = base;
+    push_arraytemp(&descriptor, VAR_INTLONG);
+  }
+}
+
+/*
+** The array reductions SUM, MOD, MEAN(, VARIANCE( and DOT( work through
+** arrays in blocks of REDUCEBLOCK elements. Each block is added up using
+** four separate partial sums so that the compiler can use vector
+** instructions and the block totals are then added together using
+** compensated (Kahan) summation. This keeps the rounding error small
+** even for very large arrays. The elements of integer arrays are
+** converted to floating point a block at a time where a floating point
+** result is needed
+*/
+#define REDUCEBLOCK 256
+
+typedef struct {
+  float64 total;	/* Running total */
+  float64 carry;	/* Low-order bits lost when adding to the total */
+} fpsum;
+
+/*
+** 'add_fpsum' adds 'value' to the compensated sum 'sum'
+*/
+static void add_fpsum(fpsum *sum, float64 value) {
+  float64 adjusted, newtotal;
+  adjusted = value-sum->carry;
+  newtotal = sum->total+adjusted;
+  sum->carry = (newtotal-sum->total)-adjusted;
+  sum->total = newtotal;
+}
+
+/*
+** 'numarray_arg' evaluates an expression that should give a numeric
+** array, which can be a Basic array or a temporary one, and removes it
+** from the Basic stack. It returns the type of the array's elements,
+** VAR_INTWORD, VAR_INTLONG or VAR_FLOAT, and a copy of its descriptor
+** in 'array'. The elements of a temporary array are left on the stack
+** and 'free_stackmem' has to be called once the caller has finished
+** with them. '*istemp' is set to TRUE if this is the case
+*/
+static int32 numarray_arg(basicarray *array, boolean *istemp) {
+  stackitem arraytype;
+  expression();
+  arraytype = GET_TOPITEM;
+  if (!ISNUMARRAY(arraytype)) error(ERR_NUMARRAY);
+  *istemp = arraytype == STACK_IATEMP || arraytype == STACK_I64ATEMP || arraytype == STACK_FATEMP;
+  if (*istemp)
+    *array = pop_arraytemp();
+  else {
+    basicarray *ap = pop_array();
+    if (ap == NIL) error(ERR_NODIMS, "(");
+    *array = *ap;
+  }
+  if (arraytype == STACK_INTARRAY || arraytype == STACK_IATEMP) return VAR_INTWORD;
+  if (arraytype == STACK_INT64ARRAY || arraytype == STACK_I64ATEMP) return VAR_INTLONG;
+  return VAR_FLOAT;
+}
+
+/*
+** 'array_block' returns a pointer to 'count' elements of the numeric
+** array 'ap', whose elements are of type 'type', starting at element
+** 'start' as floating point values. Integer elements are converted into
+** 'buffer', which must be able to hold REDUCEBLOCK values
+*/
+static float64 *array_block(basicarray *ap, int32 type, int32 start, int32 count, float64 *buffer) {
+  int32 n;
+  if (type == VAR_INTWORD) {
+    int32 *p = ap->arraystart.intbase+start;
+    for (n = 0; n < count; n++) buffer[n] = TOFLOAT(p[n]);
+    return buffer;
+  }
+  if (type == VAR_INTLONG) {
+    int64 *p = ap->arraystart.int64base+start;
+    for (n = 0; n < count; n++) buffer[n] = TOFLOAT(p[n]);
+    return buffer;
+  }
+  return ap->arraystart.floatbase+start;
+}
+
+/*
+** 'sum_block' returns the sum of the 'count' values at 'p'
+*/
+static float64 sum_block(float64 *p, int32 count) {
+  float64 sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+  int32 n;
+  for (n = 0; n+4 <= count; n+=4) {
+    sum0+=p[n];
+    sum1+=p[n+1];
+    sum2+=p[n+2];
+    sum3+=p[n+3];
+  }
+  for (; n < count; n++) sum0+=p[n];
+  return (sum0+sum1)+(sum2+sum3);
+}
+
+/*
+** 'sumsq_block' returns the sum of the squares of the differences
+** between the 'count' values at 'p' and 'centre'
+*/
+static float64 sumsq_block(float64 *p, int32 count, float64 centre) {
+  float64 sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0, d0, d1, d2, d3;
+  int32 n;
+  for (n = 0; n+4 <= count; n+=4) {
+    d0 = p[n]-centre;
+    d1 = p[n+1]-centre;
+    d2 = p[n+2]-centre;
+    d3 = p[n+3]-centre;
+    sum0+=d0*d0;
+    sum1+=d1*d1;
+    sum2+=d2*d2;
+    sum3+=d3*d3;
+  }
+  for (; n < count; n++) {
+    d0 = p[n]-centre;
+    sum0+=d0*d0;
+  }
+  return (sum0+sum1)+(sum2+sum3);
+}
+
+/*
+** 'dot_block' returns the sum of the products of the 'count' pairs of
+** values at 'p' and 'q'
+*/
+static float64 dot_block(float64 *p, float64 *q, int32 count) {
+  float64 sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+  int32 n;
+  for (n = 0; n+4 <= count; n+=4) {
+    sum0+=p[n]*q[n];
+    sum1+=p[n+1]*q[n+1];
+    sum2+=p[n+2]*q[n+2];
+    sum3+=p[n+3]*q[n+3];
+  }
+  for (; n < count; n++) sum0+=p[n]*q[n];
+  return (sum0+sum1)+(sum2+sum3);
+}
+
+/*
+** 'sum_array' returns the sum of the elements of numeric array 'ap'
+** as a floating point value
+*/
+static float64 sum_array(basicarray *ap, int32 type) {
+  float64 buffer[REDUCEBLOCK];
+  fpsum sum = {0.0, 0.0};
+  int32 n, count;
+  for (n = 0; n < ap->arrsize; n+=count) {
+    count = ap->arrsize-n;
+    if (count > REDUCEBLOCK) count = REDUCEBLOCK;
+    add_fpsum(&sum, sum_block(array_block(ap, type, n, count, buffer), count));
+  }
+  return sum.total;
+}
+
+/*
+** 'sumsq_array' returns the sum of the squares of the differences
+** between the elements of numeric array 'ap' and 'centre'
+*/
+static float64 sumsq_array(basicarray *ap, int32 type, float64 centre) {
+  float64 buffer[REDUCEBLOCK];
+  fpsum sum = {0.0, 0.0};
+  int32 n, count;
+  for (n = 0; n < ap->arrsize; n+=count) {
+    count = ap->arrsize-n;
+    if (count > REDUCEBLOCK) count = REDUCEBLOCK;
+    add_fpsum(&sum, sumsq_block(array_block(ap, type, n, count, buffer), count, centre));
+  }
+  return sum.total;
+}
+
+/*
+** 'dot_array' returns the sum of the products of the corresponding
+** elements of numeric arrays 'ap' and 'bp', which are known to have
+** the same number of elements
+*/
+static float64 dot_array(basicarray *ap, int32 atype, basicarray *bp, int32 btype) {
+  float64 abuffer[REDUCEBLOCK], bbuffer[REDUCEBLOCK];
+  fpsum sum = {0.0, 0.0};
+  int32 n, count;
+  for (n = 0; n < ap->arrsize; n+=count) {
+    count = ap->arrsize-n;
+    if (count > REDUCEBLOCK) count = REDUCEBLOCK;
+    add_fpsum(&sum, dot_block(array_block(ap, atype, n, count, abuffer), array_block(bp, btype, n, count, bbuffer), count));
+  }
+  return sum.total;
+}
+
+/*
+** 'store_index' saves the index of an array element, 'index', in the
+** variable 'destination'. It is used by 'MIN(' and 'MAX('
+*/
+static void store_index(lvalue destination, int32 index) {
+  switch (destination.typeinfo) {
+  case VAR_INTWORD:
+    *destination.address.intaddr = index;
+    break;
+  case VAR_INTLONG:
+    *destination.address.int64addr = index;
+    break;
+  case VAR_FLOAT:
+    *destination.address.floataddr = TOFLOAT(index);
+    break;
+  case VAR_INTBYTEPTR:
+    check_write(destination.address.offset, sizeof(byte));
+    basicvars.offbase[destination.address.offset] = index;
+    break;
+  case VAR_INTWORDPTR:
+    store_integer(destination.address.offset, index);
+    break;
+  case VAR_FLOATPTR:
+    store_float(destination.address.offset, TOFLOAT(index));
+    break;
+  default:
+    error(ERR_VARNUM);
+  }
+}
+
+/*
+** 'array_minmax' deals with the functions 'MIN(' and 'MAX(', returning
+** the smallest or, if 'wantmax' is TRUE, the largest element of a
+** numeric array. The result is the same type as the array's elements.
+** If a variable follows the array, the index of the element is stored
+** in it. This counts the elements from zero and in the case of arrays
+** with more than one dimension treats the array as one long row. The
+** index of the first element found is given if more than one element
+** has the same value
+**	largest = MAX(<array> [, <variable>])
+** The extreme value is found first using a loop the compiler can turn
+** into vector instructions and the index afterwards
+*/
+static void array_minmax(boolean wantmax) {
+  basicarray array;
+  lvalue destination;
+  boolean istemp, wantindex;
+  int32 type, n, count, index, intvalue = 0;
+  int64 int64value = 0;
+  float64 fpvalue = 0.0;
+  type = numarray_arg(&array, &istemp);
+  wantindex = *basicvars.current == ',';
+  if (wantindex) {
+    basicvars.current++;
+    get_lvalue(&destination);
+  }
+  if (*basicvars.current != ')') error(ERR_RPMISS);
+  basicvars.current++;
+  count = array.arrsize;
+  index = 0;
+  if (type == VAR_INTWORD) {
+    int32 *p = array.arraystart.intbase;
+    intvalue = p[0];
+    if (wantmax) {
+      for (n = 1; n < count; n++) intvalue = p[n] > intvalue ? p[n] : intvalue;
+    } else {
+      for (n = 1; n < count; n++) intvalue = p[n] < intvalue ? p[n] : intvalue;
+    }
+    if (wantindex) while (p[index] != intvalue) index++;
+  } else if (type == VAR_INTLONG) {
+    int64 *p = array.arraystart.int64base;
+    int64value = p[0];
+    if (wantmax) {
+      for (n = 1; n < count; n++) int64value = p[n] > int64value ? p[n] : int64value;
+    } else {
+      for (n = 1; n < count; n++) int64value = p[n] < int64value ? p[n] : int64value;
+    }
+    if (wantindex) while (p[index] != int64value) index++;
+  } else {
+    float64 *p = array.arraystart.floatbase;
+    fpvalue = p[0];
+    if (wantmax) {
+      for (n = 1; n < count; n++) fpvalue = p[n] > fpvalue ? p[n] : fpvalue;
+    } else {
+      for (n = 1; n < count; n++) fpvalue = p[n] < fpvalue ? p[n] : fpvalue;
+    }
+    if (wantindex) {
+      while (index < count && p[index] != fpvalue) index++;
+      if (index == count) index = 0;	/* Array only contains NaNs */
+    }
+  }
+  if (istemp) free_stackmem();
+  if (wantindex) store_index(destination, index);
+  if (type == VAR_INTWORD)
+    push_int(intvalue);
+  else if (type == VAR_INTLONG)
+    push_int64(int64value);
+  else {
+    push_float(fpvalue);
+  }
+}
+
 /*
 ** 'fn_abs' returns the absolute value of the function's argument. The
-** values are updated in place on the Basic stack
+** values are updated in place on the Basic stack. If the argument is
+** an array, the result is an array of the same type
 */
 static void fn_abs(void) {
   stackitem numtype;
@@ -352,6 +714,13 @@ static void fn_abs(void) {
     ABS_INT64;
   else if (numtype == STACK_FLOAT)
     ABS_FLOAT;
+  else if (numtype == STACK_FLOATARRAY || numtype == STACK_FATEMP) {
+    int32 n, count;
+    float64 *base = floatarray_arg(numtype, &count);
+    for (n = 0; n < count; n++) base[n] = fabs(base[n]);
+  }
+  else if (ISNUMARRAY(numtype))
+    abs_intarray(numtype);
   else error(ERR_TYPENUM);
 }
 
@@ -492,23 +861,13 @@ static void fn_bget(void) {
 ** character string
 */
 static void fn_chr(void) {
-  char *cp;
   (*factor_table[*basicvars.current])();
-  if (GET_TOPITEM == STACK_INT) {
-    cp = alloc_string(1);
-    *cp = pop_int();
-    push_strtemp(1, cp);
-  }
-  else if (GET_TOPITEM == STACK_INT64) {
-    cp = alloc_string(1);
-    *cp = pop_int64();
-    push_strtemp(1, cp);
-  }
-  else if (GET_TOPITEM == STACK_FLOAT) {
-    cp = alloc_string(1);	/* obtain memory for a single character string */
-    *cp = TOINT(pop_float());	/* Cast rounds towards zero */
-    push_strtemp(1, cp);
-  }
+  if (GET_TOPITEM == STACK_INT)
+    push_string(char_string(pop_int()));
+  else if (GET_TOPITEM == STACK_INT64)
+    push_string(char_string(pop_int64()));
+  else if (GET_TOPITEM == STACK_FLOAT)
+    push_string(char_string(TOINT(pop_float())));	/* Cast rounds towards zero */
   else error(ERR_TYPENUM);
 }
 
@@ -547,6 +906,11 @@ static void fn_cos(void) {
     push_float(cos(TOFLOAT(pop_int64())));
   else if (GET_TOPITEM == STACK_FLOAT)
     push_float(cos(pop_float()));
+  else if (ISNUMARRAY(GET_TOPITEM)) {	/* COS(<array>) */
+    int32 n, count;
+    float64 *base = floatarray_arg(GET_TOPITEM, &count);
+    for (n = 0; n < count; n++) base[n] = cos(base[n]);
+  }
   else error(ERR_TYPENUM);
 }
 
@@ -631,6 +995,49 @@ static void fn_deg(void) {
   else error(ERR_TYPENUM);
 }
 
+/*
+** 'fn_dot' deals with the function 'DOT(', which returns the dot product
+** of two numeric arrays, that is, the sum of the products of their
+** corresponding elements. The arrays must have the same number of
+** elements but do not have to be the same type. The result is an
+** integer if both are integer arrays and floating point otherwise
+**	product = DOT(<array 1>, <array 2>)
+*/
+static void fn_dot(void) {
+  basicarray first, second;
+  boolean firsttemp, secondtemp;
+  int32 firsttype, secondtype, n;
+  int64 intproduct = 0;
+  float64 fpproduct = 0.0;
+  firsttype = numarray_arg(&first, &firsttemp);
+  if (*basicvars.current != ',') error(ERR_COMISS);
+  basicvars.current++;
+  secondtype = numarray_arg(&second, &secondtemp);
+  if (*basicvars.current != ')') error(ERR_RPMISS);
+  basicvars.current++;
+  if (first.arrsize != second.arrsize) error(ERR_TYPEARRAY);
+  if (firsttype == VAR_FLOAT || secondtype == VAR_FLOAT)
+    fpproduct = dot_array(&first, firsttype, &second, secondtype);
+  else if (firsttype == VAR_INTWORD && secondtype == VAR_INTWORD) {
+    int32 *p = first.arraystart.intbase, *q = second.arraystart.intbase;
+    for (n = 0; n < first.arrsize; n++) intproduct+=CAST(p[n], int64)*q[n];
+  } else {	/* At least one of the arrays is a 64-bit integer array */
+    for (n = 0; n < first.arrsize; n++) {
+      intproduct+=(firsttype == VAR_INTWORD ? first.arraystart.intbase[n] : first.arraystart.int64base[n])
+       * (secondtype == VAR_INTWORD ? second.arraystart.intbase[n] : second.arraystart.int64base[n]);
+    }
+  }
+  if (secondtemp) free_stackmem();
+  if (firsttemp) free_stackmem();
+  if (firsttype == VAR_FLOAT || secondtype == VAR_FLOAT)
+    push_float(fpproduct);
+  else if (intproduct >= -MAXINTVAL-1 && intproduct <= MAXINTVAL)
+    push_int(CAST(intproduct, int32));
+  else {
+    push_int64(intproduct);
+  }
+}
+
 /*
 ** 'fn_end' deals with the 'END' function, which pushes the address of
 ** the top of the Basic program and variables on to the Basic stack
@@ -710,6 +1117,11 @@ static void fn_exp(void) {
     push_float(exp(TOFLOAT(pop_int64())));
   else if (topitem == STACK_FLOAT)
     push_float(exp(pop_float()));
+  else if (ISNUMARRAY(topitem)) {	/* EXP(<array>) */
+    int32 n, count;
+    float64 *base = floatarray_arg(topitem, &count);
+    for (n = 0; n < count; n++) base[n] = exp(base[n]);
+  }
   else error(ERR_TYPENUM);
 }
 
@@ -742,19 +1154,18 @@ static void fn_get(void) {
 ** from the keyboard or a string from a file
 */
 static void fn_getdol(void) {
-  char *cp;
+  char *cp, *line;
   int ch;
   int32 handle, count;
   if (*basicvars.current == '#') {	/* Have encountered the 'GET$#' version */
     basicvars.current++;
     handle = eval_intfactor();
-    count = fileio_getdol(handle, basicvars.stringwork);
+    line = fileio_getline(handle, &count);
     cp = alloc_string(count);
-    memcpy(cp, basicvars.stringwork, count);
+    memcpy(cp, line, count);
     push_strtemp(count, cp);
   }
   else {	/* Normal 'GET$' - Return character read as a string */
-    cp = alloc_string(1);
     do {
 #ifdef NEWKBD
       ch=kbd_get() & 0xFF;
@@ -762,8 +1173,7 @@ static void fn_getdol(void) {
       ch=emulate_get() & 0xFF;
 #endif
     } while (ch==0);
-    *cp = ch;
-    push_strtemp(1, cp);
+    push_string(char_string(ch));
   }
 }
 
@@ -797,9 +1207,7 @@ static void fn_inkeydol(void) {
     push_strtemp(0, cp);
   }
   else {
-    cp = alloc_string(1);
-    *cp = result;
-    push_strtemp(1, cp);
+    push_string(char_string(result));
   }
 }
 
@@ -923,8 +1331,12 @@ static void fn_int(void) {
     } else {
       push_int(TOINT(floor(pop_float())));
     }
-  } else if (GET_TOPITEM != STACK_INT && GET_TOPITEM != STACK_INT64) {
-    error(ERR_TYPENUM);
+  } else if (GET_TOPITEM == STACK_FLOATARRAY || GET_TOPITEM == STACK_FATEMP) {	/* INT(<array>) */
+    int32 n, count;
+    float64 *base = floatarray_arg(GET_TOPITEM, &count);
+    for (n = 0; n < count; n++) base[n] = floor(base[n]);
+  } else if (GET_TOPITEM != STACK_INT && GET_TOPITEM != STACK_INT64 && !ISNUMARRAY(GET_TOPITEM)) {
+    error(ERR_TYPENUM);	/* Integers and integer arrays are left as they are */
   }
 }
 
@@ -978,6 +1390,16 @@ static void fn_ln(void) {
     if (floatvalue<=0.0) error(ERR_LOGRANGE);
     push_float(log(floatvalue));
     break;
+  case STACK_INTARRAY: case STACK_IATEMP: case STACK_INT64ARRAY:
+  case STACK_I64ATEMP: case STACK_FLOATARRAY: case STACK_FATEMP: {	/* LN(<array>) */
+    int32 n, count;
+    float64 *base = floatarray_arg(GET_TOPITEM, &count);
+    for (n = 0; n < count; n++) {
+      if (base[n]<=0.0) error(ERR_LOGRANGE);
+    }
+    for (n = 0; n < count; n++) base[n] = log(base[n]);
+    break;
+  }
   default:
     error(ERR_TYPENUM);
   }
@@ -1011,14 +1433,45 @@ static void fn_log(void) {
   }
 }
 
+/*
+** 'fn_max' deals with the function 'MAX(', which returns the largest
+** element of a numeric array
+*/
+static void fn_max(void) {
+  array_minmax(TRUE);
+}
+
+/*
+** 'fn_mean' deals with the function 'MEAN(', which returns the mean
+** of the elements of a numeric array
+*/
+static void fn_mean(void) {
+  basicarray array;
+  boolean istemp;
+  int32 type;
+  float64 mean;
+  type = numarray_arg(&array, &istemp);
+  if (*basicvars.current != ')') error(ERR_RPMISS);
+  basicvars.current++;
+  mean = sum_array(&array, type)/TOFLOAT(array.arrsize);
+  if (istemp) free_stackmem();
+  push_float(mean);
+}
+
+/*
+** 'fn_min' deals with the function 'MIN(', which returns the smallest
+** element of a numeric array
+*/
+static void fn_min(void) {
+  array_minmax(FALSE);
+}
+
 /*
 ** 'fn_mod' deals with 'mod' when it is used as a function. It
 ** returns the modulus (square root of the sum of the squares)
 ** of an array
 */
 void fn_mod(void) {
-  static float64 fpsum;
-  int32 n, elements;
   variable *vp;
   basicvars.current++;		/* Skip MOD token */
   if(*basicvars.current == '(') {	/* One level of parentheses is allowed */
@@ -1030,29 +1483,16 @@ void fn_mod(void) {
   else {
     vp = get_arrayname();
   }
-  elements = vp->varentry.vararray->arrsize;
   switch (vp->varflags) {
-  case VAR_INTARRAY: {	/* Calculate the modulus of an integer array */
-    int32 *p = vp->varentry.vararray->arraystart.intbase;
-    fpsum = 0;
-    for (n=0; n<elements; n++) fpsum+=TOFLOAT(p[n])*TOFLOAT(p[n]);
-    push_float(sqrt(fpsum));
+  case VAR_INTARRAY:	/* Calculate the modulus of an integer array */
+    push_float(sqrt(sumsq_array(vp->varentry.vararray, VAR_INTWORD, 0.0)));
     break;
-  }
-  case VAR_INT64ARRAY: {	/* Calculate the modulus of an integer array */
-    int64 *p = vp->varentry.vararray->arraystart.int64base;
-    fpsum = 0;
-    for (n=0; n<elements; n++) fpsum+=TOFLOAT(p[n])*TOFLOAT(p[n]);
-    push_float(sqrt(fpsum));
+  case VAR_INT64ARRAY:	/* Calculate the modulus of an integer array */
+    push_float(sqrt(sumsq_array(vp->varentry.vararray, VAR_INTLONG, 0.0)));
     break;
-  }
-  case VAR_FLOATARRAY: {	/* Calculate the modulus of a floating point array */
-    float64 *p = vp->varentry.vararray->arraystart.floatbase;
-    fpsum = 0;
-    for (n=0; n<elements; n++) fpsum+=p[n]*p[n];
-    push_float(sqrt(fpsum));
+  case VAR_FLOATARRAY:	/* Calculate the modulus of a floating point array */
+    push_float(sqrt(sumsq_array(vp->varentry.vararray, VAR_FLOAT, 0.0)));
     break;
-  }
   case VAR_STRARRAY:
     error(ERR_NUMARRAY);	/* Numeric array wanted */
     break;
@@ -1210,52 +1650,181 @@ static void fn_retcode(void) {
 /*
 ** 'nextrandom' updates the pseudo-random number generator
 **
-** Based on the BASIC II pseudo-random number generator
+** Based on the BASIC II pseudo-random number generator. This is a
+** 33-bit shift register, the 32 bits of 'lastrandom' with the bit in
+** 'randomoverflow' above them, that is shifted left 32 times to give
+** the next number. The new bit shifted in each time is bit 19 exclusive
+** or'ed with bit 32. Rather than go round a loop 32 times, the first 20
+** new bits are calculated together from the old value and the last 12
+** from the first 20
 */
 static void nextrandom(void) {
-  int n;
-  for (n=0; n<32; n++) {
-    int newbit = ((lastrandom>>19) ^ randomoverflow) & 1;
-    randomoverflow = lastrandom>>31;
-    lastrandom = (lastrandom<<1) | newbit;
-  }
+  uint64 state;
+  uint32 newbits;
+  state = (CAST(randomoverflow & 1, uint64)<<32) | CAST(lastrandom, uint32);
+  newbits = CAST(((state>>13) ^ state) & 0xFFFFF, uint32)<<12;
+  newbits |= ((newbits>>20) ^ CAST(state>>1, uint32)) & 0xFFF;
+  randomoverflow = lastrandom & 1;
+  lastrandom = newbits;
 }
 
 /*
 ** 'randomfraction' returns the pseudo-random number as float fraction
 */
 static float64 randomfraction(void) {
-  uint32 reversed = ((lastrandom>>24)&0xFF)|((lastrandom>>8)&0xFF00)|((lastrandom<<8)&0xFF0000)|((lastrandom<<24)&0xFF000000);
-
+  uint32 reversed;
+  if (randomgenerator == RND_XOSHIRO) return TOFLOAT(lastxoshiro>>11) / 9007199254740992.0;
+  reversed = ((lastrandom>>24)&0xFF)|((lastrandom>>8)&0xFF00)|((lastrandom<<8)&0xFF0000)|((lastrandom<<24)&0xFF000000);
   return TOFLOAT(reversed) / 4294967296.0;
 }
 
+/*
+** 'nextxoshiro' steps the xoshiro256** generator on to its next value.
+** This is the generator described by Blackman and Vigna. It has a
+** period of 2**256-1 and is much better statistically than the BASIC II
+** one but gives a different sequence of numbers
+*/
+static void nextxoshiro(void) {
+  uint64 shifted = xoshiro[1]<<17;
+  lastxoshiro = xoshiro[1]*5;
+  lastxoshiro = ((lastxoshiro<<7) | (lastxoshiro>>57))*9;
+  xoshiro[2] ^= xoshiro[0];
+  xoshiro[3] ^= xoshiro[1];
+  xoshiro[1] ^= xoshiro[2];
+  xoshiro[0] ^= xoshiro[3];
+  xoshiro[2] ^= shifted;
+  xoshiro[3] = (xoshiro[3]<<45) | (xoshiro[3]>>19);
+}
+
+/*
+** 'seed_random' reseeds both pseudo-random number generators using
+** 'seed'. The four words of the xoshiro256** generator's state are
+** filled in using the SplitMix64 generator as its authors recommend
+*/
+static void seed_random(int32 seed) {
+  uint64 mix = CAST(seed, uint64);
+  int n;
+  lastrandom = seed;
+  randomoverflow = 0;
+  for (n=0; n<4; n++) {
+    uint64 z = (mix+=0x9E3779B97F4A7C15ull);
+    z = (z ^ (z>>30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z>>27))*0x94D049BB133111EBull;
+    xoshiro[n] = z ^ (z>>31);
+  }
+  lastxoshiro = 0;
+}
+
+/*
+** 'random_step' moves the generator currently in use on to its next
+** value and returns the value in the form returned by 'RND' without
+** a parameter, a 32-bit integer
+*/
+static int32 random_step(void) {
+  if (randomgenerator == RND_XOSHIRO) {
+    nextxoshiro();
+    return CAST(lastxoshiro>>32, int32);
+  }
+  nextrandom();
+  return lastrandom;
+}
+
+/*
+** 'select_random' chooses the pseudo-random number generator that
+** RND uses, returning the one that was in use. It is called by the
+** SYS 'Brandy_RandomGenerator'
+*/
+int32 select_random(int32 generator) {
+  int32 previous = randomgenerator;
+  randomgenerator = generator == RND_XOSHIRO ? RND_XOSHIRO : RND_BASIC;
+  return previous;
+}
+
+/*
+** 'rnd_array' deals with 'RND(' when its parameter is an array. It
+** fills the array with pseudo-random numbers in one go, giving the same
+** values as setting each element in turn to RND(<range>) or, if there
+** is no range, to RND(1) for floating point arrays and RND for integer
+** arrays. The function returns the number of elements filled.
+**	count% = RND(<array> [, <range>])
+*/
+static void rnd_array(stackitem arraytype) {
+  basicarray *ap;
+  int32 n, count, range;
+  float64 scale;
+  ap = pop_array();
+  if (ap == NIL) error(ERR_NODIMS, "(");
+  range = 0;
+  if (*basicvars.current == ',') {
+    basicvars.current++;
+    range = eval_integer();
+    if (range<1) error(ERR_RANGE);
+  }
+  if (*basicvars.current != ')') error(ERR_RPMISS);
+  basicvars.current++;
+  count = ap->arrsize;
+  scale = TOFLOAT(range);
+  if (arraytype == STACK_FLOATARRAY) {
+    float64 *p = ap->arraystart.floatbase;
+    for (n=0; n<count; n++) {
+      random_step();
+      p[n] = range <= 1 ? randomfraction() : TOFLOAT(TOINT(1+randomfraction()*scale));
+    }
+  } else if (arraytype == STACK_INTARRAY) {
+    int32 *p = ap->arraystart.intbase;
+    for (n=0; n<count; n++) {
+      p[n] = random_step();
+      if (range>0) p[n] = TOINT(range == 1 ? randomfraction() : 1+randomfraction()*scale);
+    }
+  } else {
+    int64 *p = ap->arraystart.int64base;
+    for (n=0; n<count; n++) {
+      p[n] = random_step();
+      if (range>0) p[n] = TOINT(range == 1 ? randomfraction() : 1+randomfraction()*scale);
+    }
+  }
+  push_int(count);
+}
+
 /*
 ** 'fn_rnd' evaluates the function 'RND'.
 */
 static void fn_rnd(void) {
-  int32 value;
+  int32 value = 0;
+  stackitem numtype;
   if (*basicvars.current == '(') {		/* Have got 'RND()' */
     basicvars.current++;
-    value = eval_integer();
+    expression();
+    numtype = GET_TOPITEM;
+    if (numtype == STACK_INTARRAY || numtype == STACK_INT64ARRAY || numtype == STACK_FLOATARRAY) {
+      rnd_array(numtype);
+      return;
+    }
+    if (numtype == STACK_INT)
+      value = pop_int();
+    else if (numtype == STACK_INT64)
+      value = INT64TO32(pop_int64());
+    else if (numtype == STACK_FLOAT)
+      value = TOINT(pop_float());
+    else {
+      error(ERR_TYPENUM);
+    }
     if (*basicvars.current != ')') error(ERR_RPMISS);
     basicvars.current++;
     if (value<0) {	/* Negative value = reseed random number generator */
-      lastrandom = value;
-      randomoverflow = 0;
+      seed_random(value);
       push_int(value);
     } else if (value == 0) {	/* Return last result */
       push_float(randomfraction());
     } else if (value == 1) {	/* Return value in range 0 to 0.9999999999 */
-      nextrandom();
+      random_step();
       push_float(randomfraction());
     } else {
-      nextrandom();
+      random_step();
       push_int(TOINT(1+randomfraction()*TOFLOAT(value)));
     }
   } else {	/* Return number in the range 0x80000000..0x7fffffff */
-    nextrandom();
-    push_int(lastrandom);
+    push_int(random_step());
   }
 }
 
@@ -1306,9 +1875,169 @@ static void fn_sin(void) {
     push_float(sin(TOFLOAT(pop_int64())));
   else if (GET_TOPITEM == STACK_FLOAT)
     push_float(sin(pop_float()));
+  else if (ISNUMARRAY(GET_TOPITEM)) {	/* SIN(<array>) */
+    int32 n, count;
+    float64 *base = floatarray_arg(GET_TOPITEM, &count);
+    for (n = 0; n < count; n++) base[n] = sin(base[n]);
+  }
   else error(ERR_TYPENUM);
 }
 
+/*
+** 'store_field' copies the 'length' characters at 'text' to the string
+** array element 'sp'. The string memory of the element is used again if
+** the field fits in the same bin or is shorter than the old string
+*/
+static void store_field(basicstring *sp, char *text, int32 length) {
+  if (length<=sp->stringlen)
+    sp->stringaddr = resize_string(sp->stringaddr, sp->stringlen, length);
+  else {
+    char *cp = alloc_string(length);
+    free_string(*sp);
+    sp->stringaddr = cp;
+  }
+  if (length>0) memmove(sp->stringaddr, text, length);
+  sp->stringlen = length;
+}
+
+/*
+** 'find_delimiter' returns a pointer to the first occurence of the
+** string 'delimiter' in the text from 'cp' to 'end' or 'end' if it
+** is not found
+*/
+static char *find_delimiter(char *cp, char *end, basicstring delimiter) {
+  char *p;
+  if (delimiter.stringlen == 1) {
+    p = memchr(cp, *delimiter.stringaddr, end-cp);
+    return p == NIL ? end : p;
+  }
+  for (p = cp; p+delimiter.stringlen<=end; p++) {
+    p = memchr(p, *delimiter.stringaddr, end-p);
+    if (p == NIL || p+delimiter.stringlen>end) break;
+    if (memcmp(p, delimiter.stringaddr, delimiter.stringlen) == 0) return p;
+  }
+  return end;
+}
+
+/*
+** 'in_elements' returns TRUE if the string 'string' starts inside the
+** text of one of the 'count' string array elements at 'elements'
+*/
+static boolean in_elements(basicstring string, basicstring *elements, int32 count) {
+  int32 n;
+  if (string.stringlen == 0) return FALSE;
+  for (n=0; n<count; n++) {
+    if (string.stringaddr>=elements[n].stringaddr
+     && string.stringaddr<elements[n].stringaddr+elements[n].stringlen) return TRUE;
+  }
+  return FALSE;
+}
+
+/*
+** 'dup_string' returns a descriptor for a copy of the string 'string'
+** on the string heap
+*/
+static basicstring dup_string(basicstring string) {
+  char *cp = alloc_string(string.stringlen);
+  memmove(cp, string.stringaddr, string.stringlen);
+  string.stringaddr = cp;
+  return string;
+}
+
+/*
+** 'fn_split' deals with the function 'SPLIT('. This splits a string into
+** fields separated by a delimiter string, storing the fields in the
+** elements of a string array. The function returns the number of fields
+** found, which can be more than the number of elements in the array in
+** which case the extra fields are not stored. If the optional fourth
+** parameter is non-zero, the string is treated as a CSV record: fields
+** can be enclosed in double quotes, in which case they can contain the
+** delimiter, and a pair of double quotes within a quoted field is taken
+** to be one double quote.
+**	fields% = SPLIT(record$, ",", field$() [, csv%])
+*/
+static void fn_split(void) {
+  stackitem stringtype, delimtype;
+  basicstring string, delimiter, *elements;
+  basicarray *ap;
+  boolean csv;
+  char *cp, *end, *field, *next, *work;
+  int32 count, length;
+  expression();
+  stringtype = GET_TOPITEM;
+  if (stringtype != STACK_STRING && stringtype != STACK_STRTEMP) error(ERR_TYPESTR);
+  string = pop_string();
+  if (*basicvars.current != ',') error(ERR_COMISS);
+  basicvars.current++;
+  expression();
+  delimtype = GET_TOPITEM;
+  if (delimtype != STACK_STRING && delimtype != STACK_STRTEMP) error(ERR_TYPESTR);
+  delimiter = pop_string();
+  if (delimiter.stringlen == 0) error(ERR_BADSTRING);
+  if (*basicvars.current != ',') error(ERR_COMISS);
+  basicvars.current++;
+  expression();
+  if (GET_TOPITEM != STACK_STRARRAY) error(ERR_STRARRAY);
+  ap = pop_array();
+  if (ap->dimcount != 1) error(ERR_NOTONEDIM);	/* Must be a 1-D array */
+  csv = FALSE;
+  if (*basicvars.current == ',') {	/* CSV flag supplied */
+    basicvars.current++;
+    csv = eval_integer() != 0;
+  }
+  if (*basicvars.current != ')') error(ERR_RPMISS);
+  basicvars.current++;
+  elements = ap->arraystart.stringbase;
+/*
+** If the string being split or the delimiter is, or is part of, one of
+** the elements of the array, take a copy of it as the element could be
+** overwritten part way through
+*/
+  if (stringtype == STACK_STRING && in_elements(string, elements, ap->arrsize)) {
+    string = dup_string(string);
+    stringtype = STACK_STRTEMP;
+  }
+  if (delimtype == STACK_STRING && in_elements(delimiter, elements, ap->arrsize)) {
+    delimiter = dup_string(delimiter);
+    delimtype = STACK_STRTEMP;
+  }
+  count = 0;
+  cp = string.stringaddr;
+  end = cp+string.stringlen;
+  if (cp<end) {
+    do {
+      if (csv && cp<end && *cp == '"') {	/* Quoted field - Copy it without the quotes */
+        work = basicvars.stringwork;
+        cp++;
+        while (cp<end && (*cp != '"' || (cp+1<end && cp[1] == '"'))) {
+          if (*cp == '"') cp++;		/* Two double quotes stand for one */
+          *work++ = *cp++;
+        }
+        if (cp<end) cp++;		/* Skip closing quote */
+        next = find_delimiter(cp, end, delimiter);
+        if (next>cp) {	/* Add anything between the closing quote and the delimiter */
+          memmove(work, cp, next-cp);
+          work+=next-cp;
+        }
+        field = basicvars.stringwork;
+        length = work-basicvars.stringwork;
+      }
+      else {	/* Unquoted field */
+        next = find_delimiter(cp, end, delimiter);
+        field = cp;
+        length = next-cp;
+      }
+      if (count<ap->arrsize) store_field(&elements[count], field, length);
+      count++;
+      if (next == end) break;	/* Reached the last field */
+      cp = next+delimiter.stringlen;
+    } while (TRUE);
+  }
+  if (delimtype == STACK_STRTEMP) free_string(delimiter);
+  if (stringtype == STACK_STRTEMP) free_string(string);
+  push_int(count);
+}
+
 /*
 ** 'fn_sqr' evaluates the square root of its argument
 */
@@ -1326,6 +2055,13 @@ static void fn_sqr(void) {
     floatvalue = pop_float();
     if (floatvalue<0.0) error(ERR_NEGROOT);
     push_float(sqrt(floatvalue));
+  } else if (ISNUMARRAY(GET_TOPITEM)) {	/* SQR(<array>) */
+    int32 n, count;
+    float64 *base = floatarray_arg(GET_TOPITEM, &count);
+    for (n = 0; n < count; n++) {
+      if (base[n]<0.0) error(ERR_NEGROOT);
+    }
+    for (n = 0; n < count; n++) base[n] = sqrt(base[n]);
   } else error(ERR_TYPENUM);
 }
 
@@ -1455,11 +2191,16 @@ static void fn_sum(void) {
   else {	/* Got 'SUM' */
     switch (vp->varflags) {
     case VAR_INTARRAY: {	/* Calculate sum of elements in an integer array */
-      int32 intsum, *p;
+/*
+** As with '+', the sum wraps around if it does not fit in 32 bits. It
+** is formed unsigned as signed overflow is undefined in C
+*/
+      int32 *p;
+      uint32 intsum;
       p = vp->varentry.vararray->arraystart.intbase;
       intsum = 0;
-      for (n=0; n<elements; n++) intsum+=p[n];
-      push_int(intsum);
+      for (n=0; n<elements; n++) intsum+=CAST(p[n], uint32);
+      push_int(CAST(intsum, int32));
       break;
     }
     case VAR_INT64ARRAY: {	/* Calculate sum of elements in an integer array */
@@ -1467,17 +2208,12 @@ static void fn_sum(void) {
       p = vp->varentry.vararray->arraystart.int64base;
       intsum = 0;
       for (n=0; n<elements; n++) intsum+=p[n];
-      push_int(intsum);
+      push_int64(intsum);
       break;
     }
-    case VAR_FLOATARRAY: {	/* Calculate sum of elements in a floating point array */
-      float64 fpsum, *p;
-      fpsum = 0;
-      p = vp->varentry.vararray->arraystart.floatbase;
-      for (n=0; n<elements; n++) fpsum+=p[n];
-      push_float(fpsum);
+    case VAR_FLOATARRAY:	/* Calculate sum of elements in a floating point array */
+      push_float(sum_array(vp->varentry.vararray, VAR_FLOAT));
       break;
-    }
     case VAR_STRARRAY: {	/* Concatenate all strings in a string array */
       int32 length, strlen;
       char *cp, *cp2;
@@ -1637,6 +2373,26 @@ static void fn_val(void) {
 #endif
 }
 
+/*
+** 'fn_variance' deals with the function 'VARIANCE(', which returns the
+** variance of the elements of a numeric array, that is, the mean of
+** the squares of their differences from the mean of the elements. The
+** array is taken to be the whole population rather than a sample
+*/
+static void fn_variance(void) {
+  basicarray array;
+  boolean istemp;
+  int32 type;
+  float64 mean, variance;
+  type = numarray_arg(&array, &istemp);
+  if (*basicvars.current != ')') error(ERR_RPMISS);
+  basicvars.current++;
+  mean = sum_array(&array, type)/TOFLOAT(array.arrsize);
+  variance = sumsq_array(&array, type, mean)/TOFLOAT(array.arrsize);
+  if (istemp) free_stackmem();
+  push_float(variance);
+}
+
 /*
 ** fn_vdu - Handle VDU when it is used as a function. It pushes
 ** the value of the VDU variable after the function name
@@ -1844,7 +2600,9 @@ static void (*function_table[])(void) = {
   fn_reportdol, fn_retcode, fn_rnd, fn_sgn, 		/* 34..37 */
   fn_sin, fn_sqr, fn_str, fn_string,  			/* 38..3B */
   fn_sum, fn_tan, fn_tempofn, fn_usr, 			/* 3C..3F */
-  fn_val, fn_verify, fn_vpos, fn_xlatedol		/* 40..43 */
+  fn_val, fn_verify, fn_vpos, fn_xlatedol,		/* 40..43 */
+  fn_split, fn_dot, fn_max, fn_mean,			/* 44..47 */
+  fn_min, fn_variance					/* 48..49 */
 };
 
 /*
@@ -1853,7 +2611,7 @@ static void (*function_table[])(void) = {
 void exec_function(void) {
   byte token = *(basicvars.current+1);
   basicvars.current+=2;
-  if (token>BASIC_TOKEN_XLATEDOL) bad_token();	/* Function token is out of range */
+  if (token>BASIC_TOKEN_VARIANCE) bad_token();	/* Function token is out of range */
   (*function_table[token])();
 }
 
@@ -1862,6 +2620,5 @@ void exec_function(void) {
 */
 void init_functions(void) {
   srand( (unsigned)time( NULL ) );
-  lastrandom=rand();
-  randomoverflow = 0;
+  seed_random(rand());
 }
@@ -28,6 +28,7 @@
 
 extern void exec_function(void);
 extern void init_functions(void);
+extern int32 select_random(int32);
 
 /*
 ** The following functions are invoked from the factor function
@@ -336,6 +336,38 @@ void exec_beats(void) {
   mos_wrbeat(beats);
 }
 
+/*
+** 'write_array' is called when the value on top of the Basic stack is
+** a whole array to write it to the file with handle 'handle'. 'raw' is
+** TRUE if the elements are to be written as 'BPUT#' does and FALSE if
+** they are to be written in 'PRINT#' format. It returns FALSE if the
+** item is not an array
+*/
+static boolean write_array(int32 handle, boolean raw) {
+  basicarray *ap, temparray;
+  int32 vartype, n;
+  switch (GET_TOPITEM) {
+  case STACK_INTARRAY: case STACK_INT64ARRAY: case STACK_FLOATARRAY: case STACK_STRARRAY:
+    vartype = GET_TOPITEM==STACK_INTARRAY ? VAR_INTARRAY : (GET_TOPITEM==STACK_INT64ARRAY ? VAR_INT64ARRAY :
+     (GET_TOPITEM==STACK_FLOATARRAY ? VAR_FLOATARRAY : VAR_STRARRAY));
+    ap = pop_array();
+    fileio_printarray(handle, vartype, ap, raw);
+    return TRUE;
+  case STACK_IATEMP: case STACK_I64ATEMP: case STACK_FATEMP: case STACK_SATEMP:
+    vartype = GET_TOPITEM==STACK_IATEMP ? VAR_INTARRAY : (GET_TOPITEM==STACK_I64ATEMP ? VAR_INT64ARRAY :
+     (GET_TOPITEM==STACK_FATEMP ? VAR_FLOATARRAY : VAR_STRARRAY));
+    temparray = pop_arraytemp();
+    fileio_printarray(handle, vartype, &temparray, raw);
+    if (vartype==VAR_STRARRAY) {	/* Discard the temporary strings */
+      for (n=0; n<temparray.arrsize; n++) free_string(temparray.arraystart.stringbase[n]);
+    }
+    free_stackmem();
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
 /*
 ** 'exec_bput' deals with the 'BPUT' statement
 ** This is an extended version of the statement that allows a
@@ -368,8 +400,8 @@ void exec_bput(void) {
       if (ateol[*basicvars.current]) fileio_bput(handle, '\n');
       if (stringtype == STACK_STRTEMP) free_string(descriptor);
       break;
-    default:	/* Item is neither a number nor a string */
-      error(ERR_VARNUMSTR);
+    default:	/* Item is neither a number nor a string - Try an array */
+      if (!write_array(handle, TRUE)) error(ERR_VARNUMSTR);
     }
     if (*basicvars.current == ',')	/* Anything more to come? */
       basicvars.current++;		/* Yes */
@@ -385,6 +417,29 @@ void exec_bput(void) {
   } while (TRUE);
 }
 
+/*
+** 'exec_bget' deals with 'BGET#' used as a statement. This fills
+** whole arrays with the raw data written by 'BPUT#', for example:
+**	BGET#handle, array()
+*/
+void exec_bget(void) {
+  int32 handle, vartype;
+  lvalue destination;
+  basicvars.current++;		/* Skip BGET token */
+  if (*basicvars.current != '#') error(ERR_HASHMISS);
+  basicvars.current++;
+  handle = eval_intfactor();	/* Get the file handle */
+  do {
+    if (*basicvars.current != ',') error(ERR_COMISS);
+    basicvars.current++;
+    get_lvalue(&destination);
+    vartype = destination.typeinfo & PARMTYPEMASK;
+    if (vartype!=VAR_INTARRAY && vartype!=VAR_INT64ARRAY && vartype!=VAR_FLOATARRAY && vartype!=VAR_STRARRAY) error(ERR_VARARRAY);
+    if (*destination.address.arrayaddr==NIL) error(ERR_NODIMS, "(");
+    fileio_getarray(handle, vartype, *destination.address.arrayaddr, TRUE);
+  } while (!ateol[*basicvars.current]);
+}
+
 /*
 ** 'exec_circle' deals with the Basic statement 'CIRCLE'
 */
@@ -822,7 +877,8 @@ void exec_gcol(void) {
 ** out in the 'fileio' module. It should be done here.
 */
 static void input_file(void) {
-  int32 handle, length, intvalue;
+  int32 handle, length;
+  int64 intvalue;
   float64 floatvalue;
   char *cp;
   boolean isint;
@@ -837,7 +893,11 @@ static void input_file(void) {
     switch (destination.typeinfo & PARMTYPEMASK) {
     case VAR_INTWORD:
       fileio_getnumber(handle, &isint, &intvalue, &floatvalue);
-      *destination.address.intaddr = isint ? intvalue : TOINT(floatvalue);
+      *destination.address.intaddr = isint ? INT64TO32(intvalue) : TOINT(floatvalue);
+      break;
+    case VAR_INTLONG:
+      fileio_getnumber(handle, &isint, &intvalue, &floatvalue);
+      *destination.address.int64addr = isint ? intvalue : TOINT64(floatvalue);
       break;
     case VAR_FLOAT:
       fileio_getnumber(handle, &isint, &intvalue, &floatvalue);
@@ -858,7 +918,7 @@ static void input_file(void) {
       break;
     case VAR_INTWORDPTR:
       fileio_getnumber(handle, &isint, &intvalue, &floatvalue);
-      store_integer(destination.address.offset, isint ? intvalue : TOINT(floatvalue));
+      store_integer(destination.address.offset, isint ? INT64TO32(intvalue) : TOINT(floatvalue));
       break;
     case VAR_FLOATPTR:
       fileio_getnumber(handle, &isint, &intvalue, &floatvalue);
@@ -869,6 +929,10 @@ static void input_file(void) {
       length = fileio_getstring(handle, CAST(&basicvars.offbase[destination.address.offset], char *));
       basicvars.offbase[destination.address.offset+length] = asc_CR;
       break;
+    case VAR_INTARRAY: case VAR_INT64ARRAY: case VAR_FLOATARRAY: case VAR_STRARRAY:
+      if (*destination.address.arrayaddr==NIL) error(ERR_NODIMS, "(");
+      fileio_getarray(handle, destination.typeinfo & PARMTYPEMASK, *destination.address.arrayaddr, FALSE);
+      break;
     default:
       error(ERR_VARNUMSTR);
     }
@@ -1574,7 +1638,7 @@ static void print_file(void) {
       free_string(descriptor);
       break;
     default:
-      error(ERR_VARNUMSTR);
+      if (!write_array(handle, FALSE)) error(ERR_VARNUMSTR);
     }
     more = !ateol[*basicvars.current];
   }
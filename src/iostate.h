@@ -27,6 +27,7 @@
 #define __iostate_h
 
 extern void exec_beats(void);
+extern void exec_bget(void);
 extern void exec_bput(void);
 extern void exec_circle(void);
 extern void exec_clg(void);
@@ -53,6 +53,7 @@
 
 #define MAXWHENS 500		/* maximum number of WHENs allowed per CASE statement */
 #define MAXSYSPARMS 10		/* Maximum number of parameters allowed in a 'SYS' statement */
+#define MAXLOCALCACHE 32	/* Maximum number of variables in a cached 'LOCAL' statement */
 
 /* Replacement for memmove where we dedupe pairs of double quotes */
 static int memcpydedupe(char *dest, const unsigned char *src, size_t len, char dedupe) {
@@ -1219,24 +1220,78 @@ void exec_library(void) {
   check_ateol();
 }
 
+/*
+** 'cache_locvars' records the variables listed on the 'LOCAL'
+** statement that starts at 'first' on the definition of the PROC
+** or FN being executed so that the next time the statement is
+** seen the variables can be saved and restored as one block
+** without having to look at the statement again. 'locvars' gives
+** the details of the 'count' variables. Nothing is done if memory
+** for the cache entry cannot be found
+*/
+static void cache_locvars(byte *first, int32 count, lvalue locvars[]) {
+  fnprocdef *dp;
+  localcache *cp;
+  dp = basicvars.procstack->fnprocdp;
+  cp = condalloc(sizeof(localcache)+(count-1)*sizeof(lvalue));
+  if (cp == NIL) return;
+  cp->localaddr = first;
+  cp->localend = basicvars.current;
+  cp->localcount = count;
+  memmove(cp->localvars, locvars, count*sizeof(lvalue));
+  cp->nextcache = dp->localist;
+  dp->localist = cp;
+}
+
 /*
 ** 'def_locvar' handles the 'LOCAL <variable>' statement and
 ** creates local variables. If the variable already exists it
 ** just its value on the stack and resets the variable to zero.
 ** If it does not exist, a new variable is created.
+** If the statement has been seen before in this PROC or FN and
+** consists only of simple variables and arrays, the list of
+** variables cached on the PROC or FN's definition is used and all
+** of them are saved as a single block on the stack
 */
 static void def_locvar(void) {
   basicstring descriptor;
-  lvalue locvar;
+  lvalue locvar, locvars[MAXLOCALCACHE];
+  localcache *cp;
+  byte *first, *tp;
+  int32 count;
   if (basicvars.procstack == NIL) error(ERR_LOCAL);	/* LOCAL found outside a PROC or FN */
+  first = basicvars.current;
+  cp = basicvars.procstack->fnprocdp->localist;
+  while (cp != NIL && cp->localaddr != first) cp = cp->nextcache;
+  if (cp != NIL) {	/* Statement has been cached */
+    save_localblock(cp->localcount, cp->localvars);
+    basicvars.current = cp->localend;
+    check_ateol();
+    return;
+  }
+  count = 0;
   basicvars.runflags.make_array = TRUE;	/* Create arrays, do not flag errors if missing in 'get_lvalue' */
   do {
+    tp = basicvars.current;
     get_lvalue(&locvar);
+    if (count >= 0) {	/* Note variable for cache if it is a simple variable or whole array */
+      if (count < MAXLOCALCACHE && (locvar.typeinfo & VAR_POINTER) == 0 && (*tp == BASIC_TOKEN_STATICVAR
+       || *tp == BASIC_TOKEN_INTVAR || *tp == BASIC_TOKEN_INT64VAR || *tp == BASIC_TOKEN_FLOATVAR
+       || *tp == BASIC_TOKEN_STRINGVAR || *tp == BASIC_TOKEN_ARRAYVAR))
+        locvars[count++] = locvar;
+      else {
+        count = -1;
+      }
+    }
     switch (locvar.typeinfo) {	/* Now to save the variable and set it to its new initial value */
     case VAR_INTWORD:
       save_int(locvar, *locvar.address.intaddr);
       *locvar.address.intaddr = 0;
       break;
+    case VAR_INTLONG:
+      save_int64(locvar, *locvar.address.int64addr);
+      *locvar.address.int64addr = 0;
+      break;
     case VAR_FLOAT:
       save_float(locvar, *locvar.address.floataddr);
       *locvar.address.floataddr = 0.0;
@@ -1267,7 +1322,7 @@ static void def_locvar(void) {
       save_string(locvar, descriptor);
       basicvars.offbase[locvar.address.offset] = asc_CR;
       break;
-    case VAR_INTARRAY: case VAR_FLOATARRAY: case VAR_STRARRAY:
+    case VAR_INTARRAY: case VAR_INT64ARRAY: case VAR_FLOATARRAY: case VAR_STRARRAY:
       save_array(locvar);
       *locvar.address.arrayaddr = NIL;
       break;
@@ -1279,6 +1334,7 @@ static void def_locvar(void) {
   } while(TRUE);
   basicvars.runflags.make_array = FALSE;
   check_ateol();
+  if (count > 0) cache_locvars(first, count, locvars);
 }
 
 /*
@@ -1587,7 +1643,7 @@ static void exec_onbranch(void) {
         }
         while (*basicvars.current != ':' && *basicvars.current != asc_NUL) basicvars.current = skip_token(basicvars.current);	/* Find return address */
         if (*basicvars.current == ':') basicvars.current++;
-        push_proc(pp->varname, dp->parmcount);
+        push_proc(pp->varname, dp);
         basicvars.current = dp->fnprocaddr;
       }
     }
@@ -1726,7 +1782,7 @@ void exec_proc(void) {
     push_parameters(dp, vp->varname);	/* Deal with parameters */
     if (!ateol[*basicvars.current]) error(ERR_SYNTAX);
   }
-  push_proc(vp->varname, dp->parmcount);
+  push_proc(vp->varname, dp);
   if (basicvars.traces.enabled) {
     if (basicvars.traces.procs) trace_proc(vp->varname, TRUE);
     if (basicvars.traces.branches) trace_branch(basicvars.current, dp->fnprocaddr);
@@ -2349,6 +2405,10 @@ void exec_swap(void) {
 ** 'exec_sys' handles the Basic 'SYS' statement, which is used
 ** to make operating system calls. These are often refered to
 ** as 'SWIs'.
+** If the SWI name is given as a string constant, the constant is
+** replaced by the SWI number in the executable tokens the first time
+** the statement is executed, so that later calls do not have to look
+** up the name again. The source of the line is not changed
 */
 void exec_sys(void) {
   int32 n, parmcount, swino = 0;
@@ -2356,7 +2416,14 @@ void exec_sys(void) {
   stackitem parmtype;
   basicstring descriptor, tempdesc[MAXSYSPARMS];
   lvalue destination;
+  boolean hastemps;
+  byte *tp;
   basicvars.current++;
+  tp = basicvars.current+1+OFFSIZE+SIZESIZE;
+  if (*basicvars.current == BASIC_TOKEN_STRINGCON && (*tp == ',' || *tp == BASIC_TOKEN_TO || ateol[*tp])) {
+    swino = mos_getswinum(TOSTRING(get_srcaddr(basicvars.current)), GET_SIZE(basicvars.current+1+OFFSIZE));
+    set_intvalue(basicvars.current, swino);	/* OFFSIZE+SIZESIZE == INTSIZE */
+  }
   expression();		/* Fetch the SWI name or number */
   parmtype = GET_TOPITEM;
   switch (parmtype) {	/* Untangle the SWI number */
@@ -2382,6 +2449,7 @@ void exec_sys(void) {
     inregs[n] = 0;
     tempdesc[n].stringaddr = NIL;
   }
+  hastemps = FALSE;
   parmcount = 0;
   if (*basicvars.current == ',') basicvars.current++;
 /* Now gather the parameters for the SWI call */
@@ -2394,7 +2462,7 @@ void exec_sys(void) {
         inregs[parmcount] = pop_int();
         break;
       case STACK_INT64:
-        inregs[parmcount] = INT64TO32(pop_int());
+        inregs[parmcount] = pop_int64();
         break;
       case STACK_FLOAT:
         inregs[parmcount] = TOINT(pop_float());
@@ -2411,6 +2479,7 @@ void exec_sys(void) {
         cp[length] = asc_NUL;
         if (parmtype == STACK_STRTEMP) free_string(descriptor);
         inregs[parmcount] = CAST(cp, byte *)-basicvars.offbase;
+        hastemps = TRUE;
         break;
       }
       default:
@@ -2427,8 +2496,10 @@ void exec_sys(void) {
   }
 /* Make the SWI call */
   mos_sys(swino, inregs, outregs, &flags);
-  for (n=0; n<MAXSYSPARMS; n++) {	/* Discard any temporary strings used */
-    if (tempdesc[n].stringaddr != NIL) free_string(tempdesc[n]);
+  if (hastemps) {
+    for (n=0; n<MAXSYSPARMS; n++) {	/* Discard any temporary strings used */
+      if (tempdesc[n].stringaddr != NIL) free_string(tempdesc[n]);
+    }
   }
   if (ateol[*basicvars.current]) return;	/* Not returning any parameters so just go home */
   basicvars.current++;
@@ -847,6 +847,13 @@ int32 mos_adval(int32 x) {
     mos_mouse(inputvalues);
     return inputvalues[x-7];
   }
+#ifdef USE_SDL
+  if (x >= 0xFFF8 && x <= 0xFFFB) {		/* ADVAL(-5) to ADVAL(-8), free entries in sound channels 1 to 4 */
+    int32 queue[4];
+    sdl_sound_queue(0xFFFB - x + 1, queue);
+    return queue[0];
+  }
+#endif
 #ifdef NEWKBD
   if (x == 0x007F) return kbd_get0();		/* Low-level examine of keyboard buffer	*/
   if (x == 0xFFFF) return kbd_buffered();	/* ADVAL(-1), amount in keyboard buffer	*/
@@ -2230,6 +2237,50 @@ static void native_oscli(char *command, char *respfile, FILE *respfh) {
 }
 
 
+/*
+** SWI names are looked up using a hash table that is built the first
+** time a name is needed. 'swihash' holds the index in 'swilist' of the
+** first entry on each chain and 'swichain' links the entries on a chain
+*/
+#define SWIHASHSIZE 256		/* Number of chains in the SWI name hash table */
+#define SWIHASHMASK (SWIHASHSIZE-1)
+#define SWILISTSIZE (sizeof(swilist)/sizeof(switable))
+
+static int32 swihash[SWIHASHSIZE];
+static int32 swichain[SWILISTSIZE];
+static boolean swihashready = FALSE;
+
+/*
+** 'mos_swihash' returns the hash chain for the SWI name 'name'
+*/
+static int32 mos_swihash(char *name, int32 length) {
+  uint32 hashvalue = 2166136261u;	/* FNV-1a */
+  while (length > 0) {
+    hashvalue = (hashvalue ^ CAST(*name, byte))*16777619u;
+    name++;
+    length--;
+  }
+  return hashvalue & SWIHASHMASK;
+}
+
+/*
+** 'mos_initswihash' builds the SWI name hash table. Entries are added
+** in reverse order so that if a name appears in 'swilist' more than
+** once, the first occurrence is the one found, as before
+*/
+static void mos_initswihash(void) {
+  int32 ptr, chain;
+  for (chain=0; chain<SWIHASHSIZE; chain++) swihash[chain] = -1;
+  for (ptr=0; swilist[ptr].swinum!=0xFFFFFFFF; ptr++) ;
+  while (ptr > 0) {
+    ptr--;
+    chain = mos_swihash(swilist[ptr].swiname, strlen(swilist[ptr].swiname));
+    swichain[ptr] = swihash[chain];
+    swihash[chain] = ptr;
+  }
+  swihashready = TRUE;
+}
+
 /*
 ** 'mos_get_swinum' returns the SWI number corresponding to
 ** SWI 'name'
@@ -2242,10 +2293,10 @@ int32 mos_getswinum(char *name, int32 length) {
     length--;
     xflag=0x20000;
   }
-  for (ptr=0; swilist[ptr].swinum!=0xFFFFFFFF; ptr++) {
-    if ((!strncmp(name, swilist[ptr].swiname, length)) && length==strlen(swilist[ptr].swiname)) break;
-  }
-  if (swilist[ptr].swinum==0xFFFFFFFF) error(ERR_SWINAMENOTKNOWN);
+  if (!swihashready) mos_initswihash();
+  ptr = swihash[mos_swihash(name, length)];
+  while (ptr >= 0 && (strncmp(name, swilist[ptr].swiname, length) || length!=strlen(swilist[ptr].swiname))) ptr = swichain[ptr];
+  if (ptr < 0) error(ERR_SWINAMENOTKNOWN);
   return ((swilist[ptr].swinum)+xflag);
 }
 
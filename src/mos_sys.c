@@ -34,9 +34,14 @@
 #include "mos_sys.h"
 #include "screen.h"
 #include "keyboard.h"
+#include "functions.h"
+#include "tokens.h"
+#include "statement.h"
+#include "editor.h"
 #ifdef USE_SDL
 #include "SDL.h"
 #include "graphsdl.h"
+#include "soundsdl.h"
 #endif
 
 typedef struct {
@@ -101,6 +106,30 @@ static gpio2rpistruct rpiboards[]={
 
 char outstring[65536];
 
+#if defined(TARGET_UNIX) | defined(TARGET_MACOSX) | defined(TARGET_GNU)
+#define USE_WORKERS
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define MAXWORKERS 256		/* Most worker processes that can be started by one call */
+#define SHAREDHINT CAST(0x40000000, void *)	/* Preferred address of block shared with workers */
+
+static byte *sharedblock = NIL;	/* Block of memory shared with worker processes */
+static size_t sharedsize = 0;	/* Size of shared block in bytes */
+#endif
+
+/*
+** 'mossys_outstring' clears the buffer used to return strings from
+** SWIs and returns its address. Only the SWIs that return a string
+** clear it, rather than every SWI call
+*/
+static char *mossys_outstring(void) {
+  memset(outstring, 0, sizeof(outstring));
+  return outstring;
+}
+
 static uint32 mossys_getboardfrommodel(uint32 model) {
   int32 ptr;
   for (ptr=0; boards[ptr].model!=0xFFFFFFFF; ptr++) {
@@ -167,6 +196,304 @@ static void mos_rpi_gpio_sys(int64 swino, int64 inregs[], int64 outregs[], int32
   }
 }
 
+/*
+** 'mossys_checkblock' checks that the block of 'length' bytes at offset
+** 'addr' lies entirely within the Basic workspace and returns its address.
+** The bulk memory SWIs make this one check per call rather than one for
+** each byte accessed
+*/
+static byte *mossys_checkblock(int64 addr, int64 length) {
+  byte *lowaddr = basicvars.offbase+addr;
+#ifdef USE_WORKERS
+  if (sharedblock != NIL && lowaddr >= sharedblock && lowaddr <= sharedblock+sharedsize
+   && length >= 0 && length <= sharedblock+sharedsize-lowaddr) return lowaddr;
+#endif
+  if (length < 0 || lowaddr < basicvars.workspace || lowaddr > basicvars.end
+   || length > basicvars.end-lowaddr) error(ERR_ADDRESS);
+  return lowaddr;
+}
+
+static uint32 crctable[8][256];	/* Tables for slice-by-8 CRC32 */
+static boolean crcready = FALSE;
+
+/*
+** 'mossys_crc32' returns the CRC32 (as used by zip, PNG and Ethernet)
+** of the 'length' bytes at 'bp'. Eight bytes are processed per step
+** using a set of tables built on first use
+*/
+static uint32 mossys_crc32(byte *bp, size_t length, uint32 crc) {
+  uint32 n, k, c;
+  if (!crcready) {
+    for (n=0; n<256; n++) {
+      c = n;
+      for (k=0; k<8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      crctable[0][n] = c;
+    }
+    for (n=0; n<256; n++) {
+      c = crctable[0][n];
+      for (k=1; k<8; k++) {
+        c = crctable[0][c & 0xFF] ^ (c >> 8);
+        crctable[k][n] = c;
+      }
+    }
+    crcready = TRUE;
+  }
+  crc = ~crc;
+  while (length >= 8) {
+    uint32 lo = crc ^ (bp[0] | (bp[1] << 8) | (bp[2] << 16) | ((uint32)bp[3] << 24));
+    crc = crctable[7][lo & 0xFF] ^ crctable[6][(lo >> 8) & 0xFF]
+        ^ crctable[5][(lo >> 16) & 0xFF] ^ crctable[4][lo >> 24]
+        ^ crctable[3][bp[4]] ^ crctable[2][bp[5]]
+        ^ crctable[1][bp[6]] ^ crctable[0][bp[7]];
+    bp+=8;
+    length-=8;
+  }
+  while (length > 0) {
+    crc = crctable[0][(crc ^ *bp) & 0xFF] ^ (crc >> 8);
+    bp++;
+    length--;
+  }
+  return ~crc;
+}
+
+#define XXH_PRIME1 2654435761u
+#define XXH_PRIME2 2246822519u
+#define XXH_PRIME3 3266489917u
+#define XXH_PRIME4 668265263u
+#define XXH_PRIME5 374761393u
+#define XXH_ROTL(x, r) (((x) << (r)) | ((x) >> (32-(r))))
+#define XXH_READ32(p) ((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((uint32)(p)[3] << 24))
+
+/*
+** 'mossys_xxhash32' returns the 32-bit xxHash of the 'length' bytes
+** at 'bp'. The four accumulators are independent so the compiler is
+** free to interleave them
+*/
+static uint32 mossys_xxhash32(byte *bp, size_t length, uint32 seed) {
+  byte *ep = bp+length;
+  uint32 h;
+  if (length >= 16) {
+    uint32 v1 = seed+XXH_PRIME1+XXH_PRIME2, v2 = seed+XXH_PRIME2;
+    uint32 v3 = seed, v4 = seed-XXH_PRIME1;
+    byte *limit = ep-16;
+    do {
+      v1 = XXH_ROTL(v1+XXH_READ32(bp)*XXH_PRIME2, 13)*XXH_PRIME1;
+      v2 = XXH_ROTL(v2+XXH_READ32(bp+4)*XXH_PRIME2, 13)*XXH_PRIME1;
+      v3 = XXH_ROTL(v3+XXH_READ32(bp+8)*XXH_PRIME2, 13)*XXH_PRIME1;
+      v4 = XXH_ROTL(v4+XXH_READ32(bp+12)*XXH_PRIME2, 13)*XXH_PRIME1;
+      bp+=16;
+    } while (bp <= limit);
+    h = XXH_ROTL(v1, 1)+XXH_ROTL(v2, 7)+XXH_ROTL(v3, 12)+XXH_ROTL(v4, 18);
+  }
+  else {
+    h = seed+XXH_PRIME5;
+  }
+  h+=(uint32)length;
+  while (bp+4 <= ep) {
+    h = XXH_ROTL(h+XXH_READ32(bp)*XXH_PRIME3, 17)*XXH_PRIME4;
+    bp+=4;
+  }
+  while (bp < ep) {
+    h = XXH_ROTL(h+(*bp)*XXH_PRIME5, 11)*XXH_PRIME1;
+    bp++;
+  }
+  h ^= h >> 15;
+  h *= XXH_PRIME2;
+  h ^= h >> 13;
+  h *= XXH_PRIME3;
+  h ^= h >> 16;
+  return h;
+}
+
+/* This function handles the bulk memory SYS calls. Addresses are offsets
+** from basicvars.offbase, as with the indirection operators.
+** This implementation is local to Brandy.
+*/
+static void mos_brandy_mem_sys(int64 swino, int64 inregs[], int64 outregs[]) {
+  byte *src, *dest, *pattern, *found;
+  int64 length, n;
+
+  switch (swino) {
+    case SWI_Brandy_MemCopy:	/* R0=dest, R1=source, R2=length. Blocks may overlap */
+      dest = mossys_checkblock(inregs[0], inregs[2]);
+      src = mossys_checkblock(inregs[1], inregs[2]);
+      memmove(dest, src, inregs[2]);
+      break;
+    case SWI_Brandy_MemFill:	/* R0=address, R1=byte value, R2=length */
+      dest = mossys_checkblock(inregs[0], inregs[2]);
+      memset(dest, inregs[1] & 0xFF, inregs[2]);
+      break;
+    case SWI_Brandy_MemCompare:	/* R0, R1=blocks, R2=length. Returns R0=-1/0/1, R1=offset of first difference */
+      dest = mossys_checkblock(inregs[0], inregs[2]);
+      src = mossys_checkblock(inregs[1], inregs[2]);
+      length = inregs[2];
+      outregs[0] = memcmp(dest, src, length);
+      outregs[1] = length;
+      if (outregs[0] != 0) {
+        for (n=0; dest[n] == src[n]; n++);
+        outregs[0] = dest[n] < src[n] ? -1 : 1;
+        outregs[1] = n;
+      }
+      break;
+    case SWI_Brandy_MemSearch:	/* R0=address, R1=length, R2=pattern or byte, R3=pattern length (0=byte in R2) */
+      src = mossys_checkblock(inregs[0], inregs[1]);
+      length = inregs[1];
+      outregs[0] = -1;
+      if (inregs[3] == 0) {
+        found = memchr(src, inregs[2] & 0xFF, length);
+        if (found != NIL) outregs[0] = found-src;
+        break;
+      }
+      pattern = mossys_checkblock(inregs[2], inregs[3]);
+      for (n=0; n <= length-inregs[3]; n++) {
+        found = memchr(src+n, pattern[0], length-inregs[3]-n+1);
+        if (found == NIL) break;
+        n = found-src;
+        if (memcmp(found, pattern, inregs[3]) == 0) {
+          outregs[0] = n;
+          break;
+        }
+      }
+      break;
+    case SWI_Brandy_MemChecksum:	/* R0=address, R1=length, R2=0 for CRC32, 1 for xxHash32, R3=seed */
+      src = mossys_checkblock(inregs[0], inregs[1]);
+      if (inregs[2] == 0)
+        outregs[0] = (int32)mossys_crc32(src, inregs[1], inregs[3]);
+      else if (inregs[2] == 1)
+        outregs[0] = (int32)mossys_xxhash32(src, inregs[1], inregs[3]);
+      else {
+        error(ERR_RANGE);
+      }
+      break;
+    case SWI_Brandy_MemByteSwap:	/* R0=address, R1=element count, R2=element size (2, 4 or 8) */
+      if (inregs[2] != 2 && inregs[2] != 4 && inregs[2] != 8) error(ERR_RANGE);
+      if (inregs[1] < 0 || inregs[1] > (basicvars.end-basicvars.workspace)/inregs[2]) error(ERR_ADDRESS);
+      dest = mossys_checkblock(inregs[0], inregs[1]*inregs[2]);
+      length = inregs[1];
+      if (inregs[2] == 2) {
+        for (n=0; n<length; n++) {
+          byte t = dest[2*n];
+          dest[2*n] = dest[2*n+1];
+          dest[2*n+1] = t;
+        }
+      }
+      else if (inregs[2] == 4) {
+        uint32 w;
+        for (n=0; n<length; n++) {
+          memcpy(&w, dest+4*n, sizeof(uint32));
+          w = (w >> 24) | ((w >> 8) & 0xFF00) | ((w << 8) & 0xFF0000) | (w << 24);
+          memcpy(dest+4*n, &w, sizeof(uint32));
+        }
+      }
+      else {
+        uint64 w;
+        for (n=0; n<length; n++) {
+          memcpy(&w, dest+8*n, sizeof(uint64));
+          w = ((w >> 56) & 0xFF) | ((w >> 40) & 0xFF00) | ((w >> 24) & 0xFF0000) | ((w >> 8) & 0xFF000000ull)
+            | ((w & 0xFF000000ull) << 8) | ((w & 0xFF0000) << 24) | ((w & 0xFF00) << 40) | (w << 56);
+          memcpy(dest+8*n, &w, sizeof(uint64));
+        }
+      }
+      break;
+  }
+}
+
+#ifdef USE_WORKERS
+/*
+** 'mossys_sharedblock' replaces the block of memory shared with worker
+** processes with a new one of 'size' bytes, filled with zeroes, and
+** returns its address as an offset from basicvars.offbase so that it
+** can be used with the indirection operators. A size of zero just
+** discards the old block. The block is mapped outside of the Basic
+** workspace as a shared mapping so that it stays shared between the
+** interpreter and the processes forked by 'mossys_runworkers'. The
+** indirection operators can only store to addresses that fit in 32
+** bits so the mapping is placed in the low 2GB of the address space
+** (SHAREDHINT is only a hint) and refused if it ends up anywhere else
+*/
+static int64 mossys_sharedblock(int64 size) {
+  void *base;
+  int flags;
+  if (size < 0) error(ERR_RANGE);
+  if (sharedblock != NIL) {
+    munmap(sharedblock, sharedsize);
+    sharedblock = NIL;
+    sharedsize = 0;
+  }
+  if (size == 0) return 0;
+  flags = MAP_SHARED | MAP_ANONYMOUS;
+#ifdef MAP_32BIT
+  flags |= MAP_32BIT;
+#endif
+  base = mmap(SHAREDHINT, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (base == MAP_FAILED) error(ERR_BADBYTEDIM);
+  if (CAST(base, byte *)+size-basicvars.offbase > MAXINTVAL) {
+    munmap(base, size);
+    error(ERR_BADBYTEDIM);
+  }
+  sharedblock = base;
+  sharedsize = size;
+  return sharedblock-basicvars.offbase;
+}
+
+/*
+** 'mossys_worker' is the code run by each worker process. It calls
+** 'PROC<name>(<shard>)' and then ends the process. The parent's
+** 'ON ERROR' handler is not used in the worker. Errors, END and
+** STOP all come back here via basicvars.restart rather than halting
+** or restarting the interpreter. The process ends with '_exit' so that
+** the interpreter's tidy-up code is not run in the worker, as that
+** would reset the terminal and close files the parent still uses
+*/
+static void mossys_worker(char *name, int32 shard) {
+  byte callline[MAXSTATELEN];
+  basicvars.runflags.quitatend = FALSE;
+  basicvars.runflags.closefiles = FALSE;
+  if (sigsetjmp(basicvars.restart, 1) != 0) {
+    fflush(stdout);
+    _exit(EXIT_FAILURE);
+  }
+  snprintf(basicvars.stringwork, MAXSTRING, "PROC%s(%d)", name, shard);
+  tokenize(basicvars.stringwork, callline, NOLINE, FALSE);
+  exec_worker(callline);
+  fflush(stdout);
+  _exit(EXIT_SUCCESS);
+}
+
+/*
+** 'mossys_runworkers' forks 'count' copies of the interpreter. Each
+** one calls the procedure 'name' with its shard number, 0 to count-1.
+** The copies share the program and its variables with the parent
+** copy-on-write, so anything they change is lost when they end apart
+** from what they write to the shared block. The function waits for
+** all of the workers to finish and returns the number that failed
+*/
+static int32 mossys_runworkers(char *name, int64 count) {
+  pid_t pids[MAXWORKERS];
+  int32 n, started, failed, status;
+  if (count < 1 || count > MAXWORKERS) error(ERR_RANGE);
+  fflush(stdout);	/* Buffered output would otherwise be written by each worker too */
+  fflush(stderr);
+  for (started=0; started<count; started++) {
+    pids[started] = fork();
+    if (pids[started] == -1) break;
+    if (pids[started] == 0) mossys_worker(name, started);
+  }
+  failed = 0;
+  for (n=0; n<started; n++) {
+    while (waitpid(pids[n], &status, 0) == -1) {
+      if (errno != EINTR) {
+        status = -1;
+        break;
+      }
+    }
+    if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) failed++;
+  }
+  if (started < count) error(ERR_CMDFAIL);
+  return failed;
+}
+#endif
+
 /* This is the handler for almost all SYS calls on non-RISC OS platforms.
 ** OS_CLI, OS_Byte, OS_Word and OS_SWINumberFromString are in mos.c
 */
@@ -177,7 +504,6 @@ void mos_sys_ext(int64 swino, int64 inregs[], int64 outregs[], int32 xflag, int6
   char *vptr;
 
   out64=(int64)(size_t)outstring; /* Ugh. Multiple casting to shut the compiler up */
-  memset(outstring,0,65536); /* Clear the output string buffer */
   if ((swino >= 256) && (swino <= 511)) { /* Handle the OS_WriteI block */
     inregs[0]=swino-256;
     swino=SWI_OS_WriteC;
@@ -227,7 +553,7 @@ void mos_sys_ext(int64 swino, int64 inregs[], int64 outregs[], int32 xflag, int6
 // R3=highest acceptable character
 // R4=b31-b24=flags, b23-b16=reserved, b15-b8=reserved, b7-b0=echochar
 //
-      vptr=outstring;
+      vptr=mossys_outstring();
       *vptr='\0';
 //                       addr   length        lochar           hichar                     flags  echo
       a=kbd_readline(vptr, inregs[1]+1, (inregs[2]<<8) | (inregs[3]<<16) | (inregs[4] & 0xFF0000FF));
@@ -237,7 +563,7 @@ void mos_sys_ext(int64 swino, int64 inregs[], int64 outregs[], int32 xflag, int6
       break;
 #else
     case SWI_OS_ReadLine:
-      vptr=outstring;
+      vptr=mossys_outstring();
       *vptr='\0';
       (void)emulate_readline(vptr, inregs[1], (inregs[0] & 0x40000000) ? (inregs[4] & 0xFF) : 0);
       a=strlen(vptr);
@@ -245,7 +571,7 @@ void mos_sys_ext(int64 swino, int64 inregs[], int64 outregs[], int32 xflag, int6
       outregs[0]=out64;
       break;
     case SWI_OS_ReadLine32:
-      vptr=outstring;
+      vptr=mossys_outstring();
       *vptr='\0';
       (void)emulate_readline(vptr, inregs[1], (inregs[4] & 0x40000000) ? (inregs[4] & 0xFF) : 0);
       a=outregs[1]=strlen(vptr);
@@ -330,7 +656,7 @@ void mos_sys_ext(int64 swino, int64 inregs[], int64 outregs[], int32 xflag, int6
       outregs[0]=emulate_setcolour((inregs[3] & 0x80), ((inregs[0] >> 8) & 0xFF), ((inregs[0] >> 16) & 0xFF), ((inregs[0] >> 24) & 0xFF));
       break;
     case SWI_Brandy_Version:
-      strncpy(outstring,BRANDY_OS,64);
+      strncpy(mossys_outstring(),BRANDY_OS,64);
       outregs[4]=out64;
       outregs[0]=atoi(BRANDY_MAJOR); outregs[1]=atoi(BRANDY_MINOR); outregs[2]=atoi(BRANDY_PATCHLEVEL);
 #ifdef BRANDY_GITCOMMIT
@@ -350,7 +676,7 @@ void mos_sys_ext(int64 swino, int64 inregs[], int64 outregs[], int32 xflag, int6
 #endif
       break;
     case SWI_Brandy_GetVideoDriver:
-      vptr=outstring;
+      vptr=mossys_outstring();
 #ifdef USE_SDL
       SDL_VideoDriverName(vptr, 64);
       outregs[2]=(matrixflags.modescreen_ptr - basicvars.offbase);
@@ -390,11 +716,45 @@ void mos_sys_ext(int64 swino, int64 inregs[], int64 outregs[], int32 xflag, int6
     case SWI_Brandy_DELisBS:
         matrixflags.delcandelete = inregs[0];
       break;
+    case SWI_Brandy_MemCopy:
+    case SWI_Brandy_MemFill:
+    case SWI_Brandy_MemCompare:
+    case SWI_Brandy_MemSearch:
+    case SWI_Brandy_MemChecksum:
+    case SWI_Brandy_MemByteSwap:
+      mos_brandy_mem_sys(swino, inregs, outregs);
+      break;
+    case SWI_Brandy_SoundQueue:	/* R0=channel. Returns R0=free entries, R1=queued, R2=depth, R3=sounds dropped */
+#ifdef USE_SDL
+      {
+        int32 queue[4];
+        sdl_sound_queue(inregs[0], queue);
+        outregs[0]=queue[0]; outregs[1]=queue[1]; outregs[2]=queue[2]; outregs[3]=queue[3];
+      }
+#else
+      outregs[0]=outregs[1]=outregs[2]=outregs[3]=0;
+#endif
+      break;
+    case SWI_Brandy_RandomGenerator:	/* R0=0 for BASIC II RND, 1 for xoshiro256**. Returns R0=previous generator */
+      outregs[0]=select_random(inregs[0]);
+      break;
+    case SWI_Brandy_ReplaceDefs:	/* R0=library name. Returns R0=number of PROCs and FNs in library */
+      outregs[0]=replace_library((char *)basicvars.offbase+inregs[0]);
+      break;
+#ifdef USE_WORKERS
+    case SWI_Brandy_SharedBlock:	/* R0=size in bytes. Returns R0=address of block */
+      outregs[0]=mossys_sharedblock(inregs[0]);
+      break;
+    case SWI_Brandy_RunWorkers:	/* R0=PROC name, R1=number of workers. Returns R0=number that failed */
+      outregs[0]=mossys_runworkers((char *)basicvars.offbase+inregs[0], inregs[1]);
+      break;
+#endif
     case SWI_RaspberryPi_GPIOInfo:
       outregs[0]=matrixflags.gpio; outregs[1]=(matrixflags.gpiomem - basicvars.offbase);
       break;
     case SWI_GPIO_GetBoard:
       file_handle=fopen("/proc/device-tree/model","r");
+      mossys_outstring();
       outregs[0]=0;
       outregs[1]=out64;
       outregs[2]=0;
@@ -108,6 +108,17 @@ typedef struct {
 #define SWI_Brandy_LegacyIntMaths			0x140006
 #define SWI_Brandy_Hex64				0x140007
 #define SWI_Brandy_DELisBS				0x140008
+#define SWI_Brandy_MemCopy				0x140009
+#define SWI_Brandy_MemFill				0x14000A
+#define SWI_Brandy_MemCompare				0x14000B
+#define SWI_Brandy_MemSearch				0x14000C
+#define SWI_Brandy_MemChecksum				0x14000D
+#define SWI_Brandy_MemByteSwap				0x14000E
+#define SWI_Brandy_SoundQueue				0x14000F
+#define SWI_Brandy_RandomGenerator			0x140010
+#define SWI_Brandy_SharedBlock				0x140011
+#define SWI_Brandy_RunWorkers				0x140012
+#define SWI_Brandy_ReplaceDefs				0x140013
 
 #define SWI_RaspberryPi_GPIOInfo			0x140100
 #define SWI_RaspberryPi_GetGPIOPortMode			0x140101
@@ -186,6 +197,17 @@ static switable swilist[] = {
 	{SWI_Brandy_LegacyIntMaths,			"Brandy_LegacyIntMaths"},
 	{SWI_Brandy_Hex64,				"Brandy_Hex64"},
 	{SWI_Brandy_DELisBS,				"Brandy_DELisBS"},
+	{SWI_Brandy_MemCopy,				"Brandy_MemCopy"},
+	{SWI_Brandy_MemFill,				"Brandy_MemFill"},
+	{SWI_Brandy_MemCompare,				"Brandy_MemCompare"},
+	{SWI_Brandy_MemSearch,				"Brandy_MemSearch"},
+	{SWI_Brandy_MemChecksum,			"Brandy_MemChecksum"},
+	{SWI_Brandy_MemByteSwap,			"Brandy_MemByteSwap"},
+	{SWI_Brandy_SoundQueue,				"Brandy_SoundQueue"},
+	{SWI_Brandy_RandomGenerator,			"Brandy_RandomGenerator"},
+	{SWI_Brandy_SharedBlock,			"Brandy_SharedBlock"},
+	{SWI_Brandy_RunWorkers,				"Brandy_RunWorkers"},
+	{SWI_Brandy_ReplaceDefs,			"Brandy_ReplaceDefs"},
 
 	{SWI_RaspberryPi_GPIOInfo,			"RaspberryPi_GPIOInfo"},
 	{SWI_RaspberryPi_GetGPIOPortMode,		"RaspberryPi_GetGPIOPortMode"},
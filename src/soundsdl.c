@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <stdlib.h>
 #include <SDL.h>
 #include <SDL_audio.h>
 #include "basicdefs.h"
@@ -52,267 +53,258 @@ static int snd_ison=0;
 static int snd_volume=127;
 
 static unsigned int snd_inited = 0;
-static int snd_paused = 0;
+static int snd_idle = 1;	/* Audio is paused because every queue was empty */
 
 static SDL_AudioSpec desiredSpec;
 
+/*
+** The output sample rate and the size of the audio buffer in sample frames
+** can be changed with the environment variables BRANDY_AUDIO_RATE and
+** BRANDY_AUDIO_BUFFER. Pitches and durations are scaled to suit the rate
+*/
+#define SNDBASERATE 20480
+#define MINSAMPLES 256
+#define MAXSAMPLES 8192
+
+static int snd_rate = SNDBASERATE;
+static int snd_samples = 2048;
+static int snd_gateframes = 128;	/* Length of each half of the percussion vibrato cycle */
+static int snd_noiseframes = 64;	/* Frames between changes of pitch in the noise voice */
+static double snd_ratescale = 1.0;	/* Converts steps at SNDBASERATE to steps at snd_rate */
+
 
 typedef struct sndent {
-signed int count;
-unsigned short int step;
+signed int count;		/* Frames left to play */
+unsigned int step;		/* Phase increment per frame */
 unsigned char vol, chant;
+unsigned char replace;		/* Cut short the sound playing when this one is reached */
 } sndent;
 
+/*
+** Each channel has a single-producer, single-consumer ring of sounds.
+** Only the interpreter writes 'head' and only the audio callback writes
+** 'tail', so neither side takes a lock. The entry at 'tail' is the one
+** playing. 'head' and 'tail' run freely and are masked to index 'entries'.
+** The depth can be set with the environment variable BRANDY_SOUND_QUEUE
+*/
+typedef struct sndqueue {
+unsigned int head;		/* Next free entry */
+unsigned int tail;		/* Entry being played */
+unsigned int dropped;		/* Sounds discarded because the queue was full */
+sndent *entries;
+} sndqueue;
+
+#define SNDQDEPTH 64
+#define SNDQMAXDEPTH 4096
 
-#define SNDTABWIDTH 64
+static sndqueue sndq[8];
+static unsigned int snd_qdepth = SNDQDEPTH;
 
-static sndent sndtab[8][SNDTABWIDTH];
+#define LOAD_ACQUIRE(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#define EXCHANGE(x, v) __atomic_exchange_n(&(x), (v), __ATOMIC_SEQ_CST)
 
-static unsigned char snd_rd[8],snd_wr[8];
-static unsigned short int soffset[8], *poffset;
-static int sactive=0;
+static unsigned int soffset[8];
+static int sgate[8];
 static unsigned char ssl[8],ssr[8];
 static const unsigned char chantype[10]={0,0,4,1,1,5,2,2,2,3};
 static unsigned char chanvoice[8];
-static unsigned char sintab[1025];
 static unsigned int steptab[312];
 static unsigned int stime[8];
 // static unsigned char sbuffer[4098];
 
-static void audio_callback(void *unused, Uint8 *ByteStream, int Length) {
-
- /* Length is length of buffer in bytes */
- int i,vl,vr,ilen,tmp,s;
- unsigned int *ptr;
- int cm1,bit;
- sndent *snd, *tptr;
-
- ilen = (Length)>>2;
- ptr = (unsigned int*)ByteStream;
- for(i=0; i<ilen; i++)
-  ptr[i]=0x80808080;
-
- if(sactive == 0){
-  SDL_PauseAudio(1);
-  snd_paused = 1;
-  return;
- } else {
-  for(bit=1, cm1=0; cm1 < snd_nvoices; cm1++, bit<<=1) {
-   if(sactive & bit){
-
-    snd = & sndtab[cm1][snd_rd[cm1]];
-    poffset = & soffset[cm1];
-
-    s = (snd->vol)*snd_volume;
-    vl = s >> (7 + ssl[cm1]);
-    vr = s >> (7 + ssr[cm1]);
-
-    if((vl>0 || vr>0) && snd->step>0 )
-     switch(snd->chant) {
-
-      case 0 : /* WaveSynth beep :- sine wave */
-       for(i=0; i<Length; i++){
-        *poffset += snd->step;
-        s = sintab[(*poffset)>>6]-128;
-
-        tmp=((int)ByteStream[i])+((vl*s)>>7);
-        if(tmp<0)tmp=0;else if(tmp>255)tmp=255;
-        ByteStream[i] = tmp;
-
-        i++;
-
-        tmp=((int)ByteStream[i])+((vr*s)>>7);
-        if(tmp<0)tmp=0;else if(tmp>255)tmp=255;
-        ByteStream[i] = tmp;
-
-       }
-      break;
-
-      case 1 : /* stringlib :- square wave */
-       for(i=0; i<Length; i++){
-        *poffset += snd->step;
-
-        if(*poffset & 0x8000) {
+/*
+** One cycle of each waveform at full scale. The top WAVEBITS bits of a
+** voice's phase index the table
+*/
+#define WAVEBITS 12
+#define WAVESIZE (1<<WAVEBITS)
+#define WAVESHIFT (32-WAVEBITS)
 
-         tmp = ByteStream[i] + vl;
-         if(tmp>255)tmp=255;
-         ByteStream[i] = tmp;
+#define WAVE_SINE 0
+#define WAVE_SQUARE 1
+#define WAVE_TRIANGLE 2
+#define WAVE_SAW 3
 
-         i++;
+static Sint16 wavetab[4][WAVESIZE];
 
-         tmp = ByteStream[i] + vr;
-         if(tmp>255)tmp=255;
-         ByteStream[i] = tmp;
+static Sint16 voicebuf[MAXSAMPLES];	/* One block of a single voice */
+static Sint32 mixbuf[2*MAXSAMPLES];	/* Stereo accumulator for all voices */
 
-        } else {
-         tmp = ByteStream[i] - vl;
-         if(tmp < 0) tmp= 0;
-         ByteStream[i] = tmp;
-
-         i++;
+/*
+** 'render_voice' fills the first 'frames' entries of voicebuf with the
+** waveform of voice 'cm1' at full scale, advancing the voice's phase.
+** Volume and stereo position are applied when the block is mixed
+*/
+static void render_voice(int cm1, sndent *snd, int frames) {
+ unsigned int phase = soffset[cm1];
+ unsigned int step = snd->step;
+ Sint16 *wave;
+ int i, j, run;
+
+ switch(snd->chant) {
+
+  case 2 : /* percussion :- square wave with vibrato */
+   wave = wavetab[WAVE_SQUARE];
+   for(i=0; i<frames; i+=run){
+    if(sgate[cm1] < snd_gateframes) {
+     run = snd_gateframes - sgate[cm1];
+     if(run > frames-i) run = frames-i;
+     for(j=0; j<run; j++){
+      phase += step;
+      voicebuf[i+j] = wave[phase >> WAVESHIFT];
+     }
+    } else {
+     run = 2*snd_gateframes - sgate[cm1];
+     if(run > frames-i) run = frames-i;
+     memset(&voicebuf[i], 0, run*sizeof(Sint16));
+     phase += step*run;
+    }
+    sgate[cm1] += run;
+    if(sgate[cm1] >= 2*snd_gateframes) sgate[cm1] = 0;
+   }
+  break;
 
-         tmp = ByteStream[i] - vr;
-         if(tmp < 0) tmp= 0;
-         ByteStream[i] = tmp;
+  case 3 : /* Percussion noise :-  pink noise */
+  {
+   static unsigned int rnd=0x1b3;
+   int nstep=1,mask=2047,m,step16;
 
-        }
-       }
-      break;
+   step16 = step >> 16;
+   while(mask > step16){
+    mask >>= 1;
+   }
+   m = mask>>1;
+
+   wave = wavetab[WAVE_SQUARE];
+   for(i=0; i<frames; i+=run){
+    if(sgate[cm1] >= snd_noiseframes) sgate[cm1] = 0;
+    if(sgate[cm1] == 0) {
+     nstep = step16 + (rnd & mask) - m;
+     if(nstep < 1) nstep = 5;
+     rnd += (rnd>>3)+1;
+     rnd += (rnd<<4)+1;
+    }
+    run = snd_noiseframes - sgate[cm1];
+    if(run > frames-i) run = frames-i;
+    for(j=0; j<run; j++){
+     phase += ((unsigned int)nstep) << 16;
+     voicebuf[i+j] = wave[phase >> WAVESHIFT];
+    }
+    sgate[cm1] += run;
+   }
+  }
+  break;
+
+  default:
+   switch(snd->chant) {
+    case 1 : wave = wavetab[WAVE_SQUARE]; break;	/* stringlib :- square wave */
+    case 4 : wave = wavetab[WAVE_TRIANGLE]; break;
+    case 5 : wave = wavetab[WAVE_SAW]; break;
+    default: wave = wavetab[WAVE_SINE]; break;	/* WaveSynth beep :- sine wave */
+   }
+   for(i=0; i<frames; i++){
+    phase += step;
+    voicebuf[i] = wave[phase >> WAVESHIFT];
+   }
+  break;
+ }
+ soffset[cm1] = phase;
+}
 
-      case 2 : /* percussion :- square wave with vibrato */
-       for(i=0; i<Length; i++){
-        *poffset += snd->step;
-        if(i & 0x100){
-         i += 0xff;
-         *poffset += (((snd->step)<<7) - snd->step); 
-        }else{
-         if(*poffset & 0x8000) {
+/*
+** 'mix_voice' adds the block in voicebuf to the stereo accumulator starting
+** at frame 'pos' with left and right volumes 'vl' and 'vr'
+*/
+static void mix_voice(int pos, int frames, int vl, int vr) {
+ Sint32 *mp = &mixbuf[2*pos];
+ int i;
 
-          tmp = ByteStream[i] + vl;
-          if(tmp>255)tmp=255;
-          ByteStream[i] = tmp;
+ for(i=0; i<frames; i++){
+  mp[2*i]   += voicebuf[i]*vl;
+  mp[2*i+1] += voicebuf[i]*vr;
+ }
+}
 
-          i++;
+static void audio_callback(void *unused, Uint8 *ByteStream, int Length) {
 
-          tmp = ByteStream[i] + vr;
-          if(tmp>255)tmp=255;
-          ByteStream[i] = tmp;
+ /* Length is length of buffer in bytes, four bytes to a frame */
+ int i,vl,vr,s,frames,pos,run,busy;
+ int cm1;
+ unsigned int head, tail, mask;
+ sndent *snd;
+ sndqueue *q;
+ Sint16 *out = (Sint16 *)ByteStream;
 
-         } else {
-          tmp = ByteStream[i] - vl;
-          if(tmp < 0) tmp= 0;
-          ByteStream[i] = tmp;
+ frames = Length >> 2;
+ if(frames > MAXSAMPLES) {
+  memset(ByteStream, 0, Length);
+  frames = MAXSAMPLES;
+ }
+ memset(mixbuf, 0, 2*frames*sizeof(Sint32));
+
+ busy = 0;
+ mask = snd_qdepth-1;
+ for(cm1=0; cm1 < snd_nvoices; cm1++) {
+  q = &sndq[cm1];
+  head = LOAD_ACQUIRE(q->head);	/* Entries before head are complete */
+  tail = q->tail;
+  pos = 0;
+  while(tail != head && pos < frames) {
+   /* a sound queued with no delay replaces the one playing */
+   while(tail+1 != head && q->entries[(tail+1) & mask].replace) tail++;
+   snd = &q->entries[tail & mask];
+   run = frames - pos;
+   if(snd->count < run) run = snd->count;
+   if(run < 0) run = 0;
+
+   s = (snd->vol)*snd_volume;
+   vl = s >> (7 + ssl[cm1]);
+   vr = s >> (7 + ssr[cm1]);
+
+   if((vl>0 || vr>0) && snd->step>0 && run>0) {
+    render_voice(cm1, snd, run);
+    mix_voice(pos, run, vl, vr);
+   }
+   pos += run;
+   snd->count -= run;
+   if(snd->count <= 0) tail++;	/* move to next sound in list */
+  }
+  STORE_RELEASE(q->tail, tail);	/* Hand finished entries back to the interpreter */
+  if(tail != head) busy = 1;
+ }
 
-          i++;
-
-          tmp = ByteStream[i] - vr;
-          if(tmp < 0) tmp= 0;
-          ByteStream[i] = tmp;
-
-         }
-        }
-       }
-      break;
-      
-      case 3 : /* Percussion noise :-  pink noise */
-      {
-       static unsigned int rnd=0x1b3;
-       int step=1,mask=2047,m;
-       
-       while(mask > snd->step){
-        mask >>= 1;
-       }
-       m = mask>>1;
-
-       for(i=0; i<Length; i++){
-
-        if((i & 63) == 0 ) {
-         step = snd->step + (rnd & mask) - m;
-         if( step < 1) step = 5;
-         rnd += (rnd>>3)+1;
-         rnd += (rnd<<4)+1;
-        }
-        
-        *poffset += step;
-
-        if(*poffset & 0x8000) {
-
-         tmp = ByteStream[i] + vl;
-         if(tmp>255)tmp=255;
-         ByteStream[i] = tmp;
-
-         i++;
-
-         tmp = ByteStream[i] + vr;
-         if(tmp>255)tmp=255;
-         ByteStream[i] = tmp;
-
-        } else {
-         tmp = ByteStream[i] - vl;
-         if(tmp < 0) tmp= 0;
-         ByteStream[i] = tmp;
-
-         i++;
-
-         tmp = ByteStream[i] - vr;
-         if(tmp < 0) tmp= 0;
-         ByteStream[i] = tmp;
-
-        }
-       }
-      }
-      break;
-
-      case 4: /*  triangle wave */
-
-       for(i=0; i<Length; i++){
-        *poffset += snd->step;
-        s = *poffset;
-        if(s >= 32768) s= 65535 -s;
-        s -= 16384;
-
-        tmp=((int)ByteStream[i])+((vl*s)>>14);
-        if(tmp>255)tmp=255;else if(tmp<0) tmp=0;
-        ByteStream[i] = tmp;
-
-        i++;
-
-        tmp=((int)ByteStream[i])+((vr*s)>>14);
-        if(tmp>255)tmp=255;else if(tmp<0) tmp=0;
-        ByteStream[i] = tmp;
-       }
-      break;
-
-      case 5: /*  saw tooth wave */
-
-       for(i=0; i<Length; i++){
-        *poffset += snd->step;
-        s = (*poffset) - 32768;
-
-        tmp=((int)ByteStream[i])+((vl*s)>>15);
-        if(tmp>255)tmp=255;else if(tmp<0) tmp=0;
-        ByteStream[i] = tmp;
-
-        i++;
-
-        tmp=((int)ByteStream[i])+((vr*s)>>15);
-        if(tmp>255)tmp=255;else if(tmp<0) tmp=0;
-        ByteStream[i] = tmp;
-       }
-      break;
-
-      default:
-      break;
-      }
-    snd->count -= Length;
-    if(snd->count <= 0){
-     snd->count = 0;
-     snd_rd[cm1] = (snd_rd[cm1]+1)&(SNDTABWIDTH-1); /* move to next sound in list */
-     tptr= & sndtab[cm1][snd_rd[cm1]];
-     if( tptr->count <= 0) { /* deactivate this channel if the next entry is empty */
-      sactive &= ~bit;
-     }
-    }
-    /* pause sound system if all channels are inactive */
-    if( (sactive & ((1<<snd_nvoices)-1)) == 0){
-     sactive = 0;
-     SDL_PauseAudio(1);
-     snd_paused = 1;
-    }
+ /* pause sound system if all channels are empty */
+ if(!busy) {
+  SDL_PauseAudio(1);
+  EXCHANGE(snd_idle, 1);
+  /* a sound may have been queued after its channel was checked */
+  for(cm1=0; cm1 < snd_nvoices; cm1++) {
+   if(LOAD_ACQUIRE(sndq[cm1].head) != sndq[cm1].tail) {
+    if(EXCHANGE(snd_idle, 0)) SDL_PauseAudio(0);
+    break;
    }
   }
  }
-//  {int j=0;for(i=0;i< Length; i+=2) sbuffer[j++] = ByteStream[i]; }
+
+ /* Saturate the whole block to 16 bits in one pass */
+ for(i=0; i<2*frames; i++){
+  s = mixbuf[i] >> 7;
+  if(s > 32767) s = 32767; else if(s < -32768) s = -32768;
+  out[i] = s;
+ }
 }
 
-static void clear_sndtab() {
+/*
+** 'clear_sndtab' empties the queues of channels 'first' to 7. The audio
+** callback must not be running, so this is done with the audio locked
+*/
+static void clear_sndtab(int first) {
  int i;
 
- memset(sndtab, 0, sizeof(sndtab));
-
- for (i=0; i< 8;i++) {
-   snd_rd[i]=1;
-   snd_wr[i]=0;
+ for (i=first; i< 8;i++) {
+   sndq[i].tail = sndq[i].head;
+   stime[i] = 0;
  }
 }
 
@@ -320,15 +312,41 @@ void init_sound(){
 
  int s,i,rv;
  double fhz;
+ char *p;
 
  // fprintf(stderr,"init_sound called\n");
 
+ p = getenv("BRANDY_AUDIO_RATE");
+ if(p != NULL && (s = atoi(p)) >= 8000 && s <= 96000) snd_rate = s;
+ p = getenv("BRANDY_AUDIO_BUFFER");
+ if(p != NULL && (s = atoi(p)) > 0) {
+  /* SDL wants a power of two */
+  for(snd_samples = MINSAMPLES; snd_samples < s && snd_samples < MAXSAMPLES; snd_samples <<= 1);
+ }
+ snd_ratescale = ((double)SNDBASERATE)/snd_rate;
+ snd_gateframes = (128*snd_rate + SNDBASERATE/2)/SNDBASERATE;
+ snd_noiseframes = (64*snd_rate + SNDBASERATE/2)/SNDBASERATE;
+
+ if(sndq[0].entries == NULL) {
+  p = getenv("BRANDY_SOUND_QUEUE");
+  if(p != NULL && (s = atoi(p)) > 0) {
+   for(snd_qdepth = 4; snd_qdepth < s && snd_qdepth < SNDQMAXDEPTH; snd_qdepth <<= 1);
+  }
+  sndq[0].entries = calloc(8*snd_qdepth, sizeof(sndent));
+  if(sndq[0].entries == NULL) {
+   fprintf(stderr,"init_sound: Not enough memory for sound queues\n");
+   snd_ison = 0;
+   return;
+  }
+  for(i=1; i<8; i++) sndq[i].entries = sndq[0].entries + i*snd_qdepth;
+ }
+
  SDL_InitSubSystem(SDL_INIT_AUDIO);
 
- desiredSpec.freq     = 20480;
- desiredSpec.format   = AUDIO_U8;
+ desiredSpec.freq     = snd_rate;
+ desiredSpec.format   = AUDIO_S16SYS;
  desiredSpec.channels = 2;
- desiredSpec.samples  = 2048;
+ desiredSpec.samples  = snd_samples;
  desiredSpec.callback = audio_callback;
  desiredSpec.userdata = (void*)0;
 
@@ -352,19 +370,20 @@ void init_sound(){
    stime[i] = 0;
  }
 
- /* init sintab */
- for(i=0; i<=256; i++){
-  s=(int)floor(128.0+(127.5*sin(((double)i)*M_PI*1.0/512.0)));
-  sintab[i]     = s;
-  sintab[512-i] = s;
-  sintab[512+i] = 255-s;
-  sintab[1024-i]= 255-s;
+ /* init wave tables */
+ for(i=0; i<WAVESIZE; i++){
+  wavetab[WAVE_SINE][i] = (Sint16)floor(0.5+(32767.0*sin(((double)i)*M_PI*2.0/WAVESIZE)));
+  wavetab[WAVE_SQUARE][i] = (i < WAVESIZE/2) ? -32767 : 32767;
+  s = i << (16-WAVEBITS);	/* Phase as 16 bits */
+  if(s >= 32768) s = 65535 - s;
+  wavetab[WAVE_TRIANGLE][i] = (s - 16384)*2;
+  wavetab[WAVE_SAW][i] = (i << (16-WAVEBITS)) - 32768;
  }
 
-/* init step tab */
+/* init step tab - this is for SNDBASERATE and is also used for volumes */
  for(i=255;i<312;i++){
   fhz = 440.0*pow(2.0, ((double)(i-89))*(1.0/48.0));
-  steptab[i] = (unsigned int)floor((fhz * (((double)0xffffffffu)/20480.0))+0.5);
+  steptab[i] = (unsigned int)floor((fhz * (((double)0xffffffffu)/SNDBASERATE))+0.5);
 
   // fprintf(stderr,"fhz is %12.4f steptab[%3d] is %9u\n",fhz,i,steptab[i]);
  }
@@ -373,15 +392,18 @@ void init_sound(){
   // fprintf(stderr,"steptab[%3d] is %9u\n",i,steptab[i]);
  }
 
- clear_sndtab();
+ clear_sndtab(0);
 
- for(i=0;i<8;i++) soffset[i]=0;
+ for(i=0;i<8;i++){
+  soffset[i]=0;
+  sgate[i]=0;
+ }
 
  SDL_Delay(40); /* Allow time for sound system to start. */
 
  SDL_PauseAudio(1);
 
- snd_paused = 1;
+ snd_idle = 1;
  snd_ison = 1;
 
  snd_tempo = 0;
@@ -398,13 +420,16 @@ void sdl_sound(int32 channel, int32 amplitude, int32 pitch, int32 duration, int3
 // channel &FFxx - BBC speech
 
  unsigned int step;
+ double fstep;
  int tvol;
  int cht;
  int cm1;
  sndent *snd;
+ sndqueue *q;
+ unsigned int head, queued;
 
  double e,f;
- int t,diff,pl;
+ int t,pl;
 
  unsigned int tnow=0;
 
@@ -431,27 +456,29 @@ void sdl_sound(int32 channel, int32 amplitude, int32 pitch, int32 duration, int3
 */
  if(pitch < 0 ) {
 
-  step = (((-pitch)<< 16)+10240)/20480;
+  fstep = ((double)-pitch)*(4294967296.0/SNDBASERATE);
 
  }else if(pitch < 256) {
-  step = steptab[pitch] >> 16; 
+  fstep = steptab[pitch];
  }else {
   // step = steptab[(int)floor( (((double)(pitch-0x1c00))*(48.0/4096.0))+89.5)] >> 16;
   e= (((double)(pitch-0x1c00))*(48.0/4096.0))+89.0;
   f=floor(e);
   e -= f;
   t=(int)f;
-  diff =  floor(0.5 + (1.0/65536.0)*e*((double)(steptab[t+1] - steptab[t])));
-  step = (steptab[t] >> 16) + diff;
-  // fprintf(stderr,"t is %3d step is %d e is %6.3f diff is %5d\n",t, step, e, diff);
+  fstep = steptab[t] + e*((double)(steptab[t+1] - steptab[t]));
+  // fprintf(stderr,"t is %3d step is %d e is %6.3f\n",t, step, e);
  }
 
- if(step > 32767) step = 32767;
+ /* Convert to the output rate, keeping below the Nyquist frequency */
+ fstep *= snd_ratescale;
+ if(fstep > 2147418112.0) fstep = 2147418112.0;
+ step = (unsigned int)floor(fstep+0.5);
 
  // fprintf(stderr,"sdl_sound called: cm1 (%2d) amplitude (%3d) pitch (%5d) duration (%3d) delay (%d) step is %d\n",cm1, amplitude, pitch, duration, delay, step);
 
 
- // fprintf(stderr,"sdl_sound: step is %d delay is %d is_on %d paused %d\n",step, delay, snd_ison, snd_paused);
+ // fprintf(stderr,"sdl_sound: step is %d delay is %d is_on %d idle %d\n",step, delay, snd_ison, snd_idle);
 
  tvol= 0;
  if(amplitude < -15)amplitude= -15;
@@ -479,92 +506,104 @@ void sdl_sound(int32 channel, int32 amplitude, int32 pitch, int32 duration, int3
  
  if(delay > 32768) delay = 32768;
 
- // fprintf(stderr,"sdl_sound tvol %3d step is %5d snd_wr[%d] = %2d snd_rd[%d] = %2d stime[%d] %4d tnow %4d sactive %2x\n", tvol, step, cm1, snd_wr[cm1], cm1, snd_rd[cm1], cm1, stime[cm1], tnow, sactive);
-
  if(!step) tvol = 0;
 
- if( ((snd_rd[cm1]-snd_wr[cm1])&(SNDTABWIDTH-1)) != 2    ){
-
-  tnow = ((unsigned int)basicvars.centiseconds - snd_inited )/5; /* divide by 5 to covert centiseconds to 20ths */
+ q = &sndq[cm1];
+ head = q->head;
+ queued = head - LOAD_ACQUIRE(q->tail);
 
-  if(stime[cm1] < tnow )
-     stime[cm1] = tnow;
+ tnow = ((unsigned int)basicvars.centiseconds - snd_inited )/5; /* divide by 5 to covert centiseconds to 20ths */
 
-  SDL_LockAudio();
-
-  if(delay > 0  &&  (pl = tnow+delay-stime[cm1]) > 0 ){
-
-    snd_wr[cm1] = (snd_wr[cm1]+1)&(SNDTABWIDTH-1);
+ if(stime[cm1] < tnow )
+    stime[cm1] = tnow;
 
-    snd = &sndtab[cm1][snd_wr[cm1]];
+ pl = 0;
+ if(delay > 0) pl = tnow+delay-stime[cm1];
 
-    snd->step    = 0; /* play silence during delay */
-    snd->count   = pl << 11;
-    snd->vol     = 0;
-    snd->chant   = 0;
+ /* never wait for the audio thread - if there is no room the sound is dropped */
+ if(queued + (pl > 0 ? 2 : 1) > snd_qdepth) {
+  q->dropped++;
+  return;
+ }
 
-    stime[cm1] += pl;
+ if(pl > 0){
+   snd = &q->entries[head & (snd_qdepth-1)];
 
-    delay = -1;
-  } else {
-    snd = &sndtab[cm1][snd_wr[cm1]];
-  }
+   snd->step    = 0; /* play silence during delay */
+   snd->count   = (int)(((int64)pl*snd_rate)/20); /* pl is in 20ths of a second */
+   snd->vol     = 0;
+   snd->chant   = 0;
+   snd->replace = 0;
+   head++;
+   queued++;
 
-  if(delay != 0 || snd_wr[cm1] != snd_rd[cm1]  || snd->count == 0 ){
-    /* move to next entry */
-    snd_wr[cm1] = (snd_wr[cm1]+1)&(SNDTABWIDTH-1);
-    snd = &sndtab[cm1][snd_wr[cm1]];
+   stime[cm1] += pl;
 
-    stime[cm1] += duration;
-
-  } else { 
-    if ( delay == 0 ) {
-     int r;
-     r = snd_rd[cm1];
-     snd = & sndtab[cm1][r]; /* over write playing entry */
-     snd_wr[cm1] = r;
-    }
-    stime[cm1] = tnow + duration;
-  }
+   delay = -1;
+ }
 
-  snd->step    = step;
-  snd->count   = duration << 11;
-  snd->vol     = tvol;
-  snd->chant   = cht;
+ snd = &q->entries[head & (snd_qdepth-1)];
 
-  sndtab[cm1][(snd_wr[cm1]+1) & (SNDTABWIDTH-1)].count = 0; /* clear next entry */
+ if(delay == 0 && queued == 1){
+   snd->replace = 1; /* over write playing entry */
+   stime[cm1] = tnow + duration;
+ } else {
+   snd->replace = 0;
+   stime[cm1] += duration;
+ }
 
-  sactive |= (1 << cm1);
+ snd->step    = step;
+ snd->count   = (int)(((int64)duration*snd_rate)/20);
+ snd->vol     = tvol;
+ snd->chant   = cht;
 
-  SDL_UnlockAudio();
+ STORE_RELEASE(q->head, head+1); /* publish the new entries to the audio callback */
 
-  // fprintf(stderr,"sdl_sound: step is %d cm1 %d type %d tvol %d sactive %d\n",step, cm1, cht, tvol, sactive);
+ // fprintf(stderr,"sdl_sound: step is %d cm1 %d type %d tvol %d\n",step, cm1, cht, tvol);
 
-  if( snd_ison && snd_paused){
-   SDL_PauseAudio(0);
-   snd_paused = 0;
-  }
- }
- 
+ if(EXCHANGE(snd_idle, 0)) SDL_PauseAudio(0);
 }
 
 void sdl_sound_onoff(int32 onoff){
- // fprintf(stderr, "sdl_sound_onoff(%d) called ison %d paused %d \n",onoff, snd_ison, snd_paused);
+ // fprintf(stderr, "sdl_sound_onoff(%d) called ison %d idle %d \n",onoff, snd_ison, snd_idle);
  if(onoff && !snd_ison ) {
   if(!snd_inited) init_sound();
   snd_ison = 1;
  } else if ( !onoff && snd_ison) {
 
   SDL_LockAudio();
-  clear_sndtab();
+  clear_sndtab(0);
+  SDL_PauseAudio(1);
+  EXCHANGE(snd_idle, 1);
   SDL_UnlockAudio();
 
   snd_ison = 0;
-  SDL_PauseAudio(1);
-  snd_paused = 1;
  }
 }
 
+/*
+** 'sdl_sound_queue' returns the state of the queue of channel 'channel':
+** the number of free entries, the number of sounds queued including the
+** one playing, the depth of the queue and how many sounds have been
+** dropped because the queue was full
+*/
+void sdl_sound_queue(int32 channel, int32 results[]){
+ sndqueue *q;
+ unsigned int queued;
+
+ if(!snd_inited) init_sound();
+
+ results[0] = results[1] = results[2] = results[3] = 0;
+ if(channel < 1 || channel > 8 || sndq[0].entries == NULL) return;
+
+ q = &sndq[channel-1];
+ queued = q->head - LOAD_ACQUIRE(q->tail);
+ results[0] = snd_qdepth - queued;
+ results[1] = queued;
+ results[2] = snd_qdepth;
+ results[3] = q->dropped;
+}
+
 void sdl_wrbeat(int32 beats){
 
  if(!snd_inited) init_sound();
@@ -689,7 +728,7 @@ void sdl_star_voices() {
 }
 
 void  sdl_voices(int32 channels) {
- int i,c,n;
+ int i,n;
 
  if(!snd_inited) init_sound();
 
@@ -701,18 +740,9 @@ void  sdl_voices(int32 channels) {
   }
  if( n >= 1 && n <= 8 ) {
     snd_nvoices = n;
-    /* if nvoices is reduced then the sndtab entries need to be cleared or they will be played if it is increased later */
+    /* if nvoices is reduced then the queues need to be cleared or they will be played if it is increased later */
     SDL_LockAudio();
-    sactive &= ((1<snd_nvoices)-1);
-    for(c = n; c < 8; c++){
-     snd_rd[c] = 1;
-     snd_wr[c] = 0;
-     stime[c]  = 0;
-     for(i = 0; i < SNDTABWIDTH; i++){
-      sndtab[c][i].count = 0;
-      sndtab[c][i].vol   = 0;
-     }
-    }
+    clear_sndtab(n);
     SDL_UnlockAudio();
  }
 }
@@ -6,6 +6,7 @@ extern void init_sound(void);
 
 extern void sdl_sound(int32, int32, int32, int32, int32);
 extern void sdl_sound_onoff(int32);
+extern void sdl_sound_queue(int32, int32 []);
 
 extern void  sdl_wrbeat(int32);
 extern int32 sdl_rdbeat(void);
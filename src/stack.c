@@ -32,6 +32,7 @@
 #include "strings.h"
 #include "tokens.h"
 #include "errors.h"
+#include "variables.h"
 
 #ifdef DEBUG
 #include <stdio.h>
@@ -68,7 +69,7 @@ static int32 entrysize [] = {
   ALIGNSIZE(stack_gosub),   ALIGNSIZE(stack_proc),      ALIGNSIZE(stack_fn),       ALIGNSIZE(stack_local),	/* 14 */
   ALIGNSIZE(stack_retparm), ALIGNSIZE(stack_while),     ALIGNSIZE(stack_repeat),   ALIGNSIZE(stack_for),	/* 18 */
   ALIGNSIZE(stack_for),     ALIGNSIZE(stack_for),       ALIGNSIZE(stack_error),    ALIGNSIZE(stack_data),	/* 1C */
-  ALIGNSIZE(stack_opstack), ALIGNSIZE(stack_restart)								/* 1E */
+  ALIGNSIZE(stack_opstack), ALIGNSIZE(stack_restart),   ALIGNSIZE(stack_localblock)					/* 1F */
 };
 
 /*
@@ -119,6 +120,7 @@ static char *entryname(stackitem what) {
     case STACK_DATA:		return "DATA";
     case STACK_OPSTACK:		return "operator stack";
     case STACK_RESTART:		return "siglongjmp block";
+    case STACK_LOCALBLOCK:	return "local variable block";
     default:
     sprintf(entry, "** Bad type %X **", what);
     return entry;
@@ -331,14 +333,15 @@ void push_arraytemp(basicarray *descriptor, int32 type) {
 /*
 ** 'push_proc' pushes the return address and so forth for a procedure call
 */
-void push_proc(char *name, int32 count) {
+void push_proc(char *name, fnprocdef *dp) {
   basicvars.stacktop.bytesp-=ALIGNSIZE(stack_proc);
   if (basicvars.stacktop.bytesp<basicvars.stacklimit.bytesp) error(ERR_STACKFULL);
   basicvars.stacktop.procsp->itemtype = STACK_PROC;
   basicvars.stacktop.procsp->fnprocblock.lastcall = basicvars.procstack;
   basicvars.stacktop.procsp->fnprocblock.retaddr = basicvars.current;
-  basicvars.stacktop.procsp->fnprocblock.parmcount = count;
+  basicvars.stacktop.procsp->fnprocblock.parmcount = dp->parmcount;
   basicvars.stacktop.procsp->fnprocblock.fnprocname = name;
+  basicvars.stacktop.procsp->fnprocblock.fnprocdp = dp;
   basicvars.procstack = &basicvars.stacktop.procsp->fnprocblock;
 #ifdef DEBUG
   if (basicvars.debug_flags.stack) fprintf(stderr, "Saving PROC return block at %p\n", basicvars.stacktop.procsp);
@@ -348,7 +351,7 @@ void push_proc(char *name, int32 count) {
 /*
 ** 'push_fn' pushes the return address and so forth for a function call
 */
-void push_fn(char *name, int32 count) {
+void push_fn(char *name, fnprocdef *dp) {
   basicvars.stacktop.bytesp-=ALIGNSIZE(stack_fn);
   if (basicvars.stacktop.bytesp<basicvars.stacklimit.bytesp) error(ERR_STACKFULL);
   basicvars.stacktop.fnsp->itemtype = STACK_FN;
@@ -357,8 +360,9 @@ void push_fn(char *name, int32 count) {
   basicvars.stacktop.fnsp->lastrestart = basicvars.local_restart;
   basicvars.stacktop.fnsp->fnprocblock.lastcall = basicvars.procstack;
   basicvars.stacktop.fnsp->fnprocblock.retaddr = basicvars.current;
-  basicvars.stacktop.fnsp->fnprocblock.parmcount = count;
+  basicvars.stacktop.fnsp->fnprocblock.parmcount = dp->parmcount;
   basicvars.stacktop.fnsp->fnprocblock.fnprocname = name;
+  basicvars.stacktop.fnsp->fnprocblock.fnprocdp = dp;
   basicvars.procstack = &basicvars.stacktop.fnsp->fnprocblock;
 #ifdef DEBUG
   if (basicvars.debug_flags.stack) fprintf(stderr, "Saving FN return block at %p\n", basicvars.stacktop.fnsp);
@@ -619,6 +623,89 @@ void save_array(lvalue details) {
 #endif
 }
 
+/*
+** 'save_localblock' saves the values of the 'count' variables described
+** by 'vars' as a single block on the stack and then sets the variables
+** to zero or the null string. It is used for a 'LOCAL' statement whose
+** variables have been cached on the PROC or FN's definition, so the
+** only types that have to be dealt with are simple variables and arrays
+*/
+void save_localblock(int32 count, lvalue *vars) {
+  savedvalue *vp;
+  int32 n;
+  if (basicvars.stacktop.bytesp-ALIGNSIZE(stack_localblock)-count*sizeof(savedvalue)<basicvars.stacklimit.bytesp) error(ERR_STACKFULL);
+  basicvars.stacktop.bytesp-=ALIGNSIZE(stack_localblock)+count*sizeof(savedvalue);
+  basicvars.stacktop.localblocksp->itemtype = STACK_LOCALBLOCK;
+  basicvars.stacktop.localblocksp->localcount = count;
+  basicvars.stacktop.localblocksp->localvars = vars;
+  vp = CAST(basicvars.stacktop.bytesp+ALIGNSIZE(stack_localblock), savedvalue *);
+#ifdef DEBUG
+  if (basicvars.debug_flags.stack) fprintf(stderr, "LOCAL variables - saving %d variables at %p\n", count, basicvars.stacktop.localblocksp);
+#endif
+  for (n=0; n<count; n++) {
+    switch (vars[n].typeinfo) {
+    case VAR_INTWORD:
+      vp[n].savedint = *vars[n].address.intaddr;
+      *vars[n].address.intaddr = 0;
+      break;
+    case VAR_INTLONG:
+      vp[n].savedint64 = *vars[n].address.int64addr;
+      *vars[n].address.int64addr = 0;
+      break;
+    case VAR_FLOAT:
+      vp[n].savedfloat = *vars[n].address.floataddr;
+      *vars[n].address.floataddr = 0.0;
+      break;
+    case VAR_STRINGDOL:
+      vp[n].savedstring = *vars[n].address.straddr;
+      vars[n].address.straddr->stringlen = 0;
+      vars[n].address.straddr->stringaddr = nullstring;
+      break;
+    default:	/* Arrays */
+      vp[n].savedarray = *vars[n].address.arrayaddr;
+      *vars[n].address.arrayaddr = NIL;
+    }
+  }
+}
+
+/*
+** 'restore_localblock' puts back the values of the variables saved
+** by 'save_localblock'. The variables are restored in the reverse of
+** the order in which they were saved in case one appears more than once
+*/
+static void restore_localblock(void) {
+  stack_localblock *p;
+  savedvalue *vp;
+  lvalue *vars;
+  int32 n;
+  p = basicvars.stacktop.localblocksp;
+  vars = p->localvars;
+  vp = CAST(basicvars.stacktop.bytesp+ALIGNSIZE(stack_localblock), savedvalue *);
+#ifdef DEBUG
+  if (basicvars.debug_flags.stack) fprintf(stderr, "Restoring %d LOCAL variables from %p\n", p->localcount, p);
+#endif
+  for (n=p->localcount-1; n>=0; n--) {
+    switch (vars[n].typeinfo) {
+    case VAR_INTWORD:
+      *vars[n].address.intaddr = vp[n].savedint;
+      break;
+    case VAR_INTLONG:
+      *vars[n].address.int64addr = vp[n].savedint64;
+      break;
+    case VAR_FLOAT:
+      *vars[n].address.floataddr = vp[n].savedfloat;
+      break;
+    case VAR_STRINGDOL:
+      free_string(*vars[n].address.straddr);
+      *vars[n].address.straddr = vp[n].savedstring;
+      break;
+    default:	/* Arrays */
+      *vars[n].address.arrayaddr = vp[n].savedarray;
+    }
+  }
+  basicvars.stacktop.bytesp+=ALIGNSIZE(stack_localblock)+p->localcount*sizeof(savedvalue);
+}
+
 /*
 ** 'save_retint' is called to set up the control block on the stack for a
 ** 'RETURN' type PROC/FN parameter where the parameter is an integer.
@@ -843,7 +930,7 @@ static void restore(int32 parmcount) {
         memmove(&basicvars.offbase[p->savedetails.address.offset], p->value.savedstring.stringaddr, p->value.savedstring.stringlen);
         free_string(p->value.savedstring);
         break;
-      case VAR_INTARRAY: case VAR_FLOATARRAY: case VAR_STRARRAY:
+      case VAR_INTARRAY: case VAR_INT64ARRAY: case VAR_FLOATARRAY: case VAR_STRARRAY:
         *p->savedetails.address.arrayaddr = p->value.savedarray;
         break;
       default:
@@ -1022,6 +1109,9 @@ static void discard(stackitem item) {
   case STACK_RETPARM:	/* Deal with a 'return' parameter and restore local parameter */
     restore_retparm(1);
     break;
+  case STACK_LOCALBLOCK:	/* Restore a block of local variables */
+    restore_localblock();
+    break;
   case STACK_GOSUB:	/* Clear 'GOSUB' block from stack */
     (void) pop_gosub();
     break;
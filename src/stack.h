@@ -42,8 +42,8 @@ extern void push_dolstring(int32, char *);
 extern void push_array(basicarray *, int32);
 extern void push_arraytemp(basicarray *, int32);
 extern void push_pointer(void *);
-extern void push_proc(char *, int32);
-extern void push_fn(char *, int32);
+extern void push_proc(char *, fnprocdef *);
+extern void push_fn(char *, fnprocdef *);
 extern void push_gosub(void);
 extern void push_while(byte *);
 extern void push_repeat(void);
@@ -80,6 +80,7 @@ extern void save_int64(lvalue, int64);
 extern void save_float(lvalue, float64);
 extern void save_string(lvalue, basicstring);
 extern void save_array(lvalue);
+extern void save_localblock(int32, lvalue *);
 extern void save_retint(lvalue, lvalue, int32);
 extern void save_retint64(lvalue, lvalue, int64);
 extern void save_retfloat(lvalue, lvalue, float64);
@@ -99,6 +100,8 @@ extern void *alloc_local(int32);
 /* The following macros are used to speed up operations on the Basic stack */
 
 #define GET_TOPITEM (basicvars.stacktop.intsp->itemtype)
+#define GET_TOPINT (basicvars.stacktop.intsp->intvalue)
+#define SET_TOPINT(x) basicvars.stacktop.intsp->intvalue = (x)
 
 #define PUSH_INT(x) basicvars.stacktop.bytesp-=ALIGN(sizeof(stack_int)); \
 		basicvars.stacktop.intsp->itemtype = STACK_INT; \
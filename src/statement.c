@@ -412,6 +412,20 @@ static void exec_statements(byte *lp) {
 // to do: put kbd_escpoll() in while()?
 }
 
+/*
+** 'note_localerrors' determines whether the program or any installed
+** library contains 'ON ERROR LOCAL', in which case functions need a
+** restart block. Libraries loaded by 'LIBRARY' are checked as they are
+** loaded
+*/
+static void note_localerrors(void) {
+  library *lp;
+  basicvars.runflags.has_localerror = FALSE;
+  scan_localerror(basicvars.start);
+  for (lp = basicvars.installist; lp != NIL; lp = lp->libflink) scan_localerror(lp->libstart);
+  for (lp = basicvars.liblist; lp != NIL; lp = lp->libflink) scan_localerror(lp->libstart);
+}
+
 /*
 ** 'run_program' runs a program. On entry, 'lp' points at the start
 ** of the line from which to start program execution. If it is 'nil'
@@ -438,6 +452,7 @@ void run_program(byte *lp) {
   clear_heap();
   clear_stack();
   init_expressions();	/* Initialise the expression evaluation code */
+  note_localerrors();
   if (lp == NIL) lp = basicvars.start;	/* Check starting position in program */
   basicvars.lastsearch = basicvars.start;
   basicvars.curcount = 0;
@@ -461,6 +476,36 @@ void run_program(byte *lp) {
   }
 }
 
+/*
+** 'exec_worker' is used by the worker processes started by the SYS
+** call 'Brandy_RunWorkers'. 'lp' points at a tokenised line that
+** holds a procedure call. The statements are interpreted until
+** the procedure returns to the end of that line. Procedure calls do
+** not use the C stack so the end of the line has to be checked for
+** explicitly. Any error handler inherited from the program that
+** started the workers is discarded first, as it would otherwise take
+** the worker back into the parent's code when an error occurs. Errors
+** trapped by 'ON ERROR' or 'ON ERROR LOCAL' in the procedure restart
+** here as they would in 'run_program'. Anything else that stops the
+** program is dealt with by the caller
+*/
+void exec_worker(byte *lp) {
+  byte *ep;
+  ep = lp+get_linelen(lp)-1;	/* Point at the NUL at the end of the line */
+  clear_error();		/* Drop the parent's 'ON ERROR' handler */
+  reset_opstack();
+  note_localerrors();
+  if (sigsetjmp(basicvars.error_restart, 1) == 0) {
+    basicvars.local_restart = &basicvars.error_restart;
+    basicvars.current = FIND_EXEC(lp);
+  }
+  else {
+    reset_opstack();
+    basicvars.current = basicvars.error_handler.current;
+  }
+  while (basicvars.current != ep) (*statements[*basicvars.current])();
+}
+
 /*
 ** 'exec_thisline' is called to interpret the statement in 'thisline'.
 ** If the length of the line is zero, that is, nothing was entered on
@@ -484,5 +529,7 @@ void exec_thisline(void) {
   basicvars.runflags.outofdata = FALSE;
   clear_error();
   reset_opstack();
+  note_localerrors();
+  if (!basicvars.runflags.has_localerror) scan_localerror(thisline);	/* The command line can contain 'ON ERROR LOCAL' too */
   exec_statements(FIND_EXEC(thisline));
 }
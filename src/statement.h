@@ -37,6 +37,7 @@ extern void init_interpreter(void);
 extern void exec_thisline(void);
 extern void exec_fnstatements(byte *);
 extern void run_program(byte *);
+extern void exec_worker(byte *);
 extern void trace_line(int32);
 extern void trace_proc(char *, boolean);
 extern void trace_branch(byte *, byte *);
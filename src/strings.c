@@ -115,6 +115,38 @@ static int32 binsizes[BINCOUNT] = {	/* Bin number -> string size */
 
 char emptystring;	/* All requests for zero bytes point here */
 
+/*
+** A string can be shared by several string variables and array elements,
+** for example, after 'a$=b$'. The number of owners of each shared string
+** is kept in 'sharetable', an open hash table indexed by the address of
+** the string. Strings with just one owner, which is nearly all of them,
+** are not in the table so nothing changes for them. 'free_string' only
+** returns a shared string to the bins when its last owner lets go of it
+** and 'resize_string' gives an owner its own copy of a shared string
+** before it can be changed. Temporary strings are never shared
+*/
+typedef struct {
+  char *shareaddr;			/* Address of shared string or NIL if entry is unused */
+  int32 sharecount;			/* Number of owners of the string */
+} sharedstring;
+
+#define SHAREMINSIZE 64			/* Initial number of entries in the shared string table */
+
+static sharedstring *sharetable;	/* Shared string table */
+static int32 sharesize;			/* Number of entries in the table (a power of two) */
+static int32 shareused;			/* Number of strings in the table */
+
+/*
+** Single character strings, such as those returned by CHR$ and GET$,
+** are not allocated on the heap. They point at the character's entry
+** in 'charstrings' instead. These strings behave as if they always
+** have another owner, so they are never freed and 'resize_string'
+** makes a copy of them before they can be changed
+*/
+static char charstrings[256];
+
+#define ISCHARSTRING(cp) ((cp)>=charstrings && (cp)<charstrings+sizeof(charstrings))
+
 static boolean collect(void);	/* Forward reference */
 
 /*
@@ -138,6 +170,130 @@ static int32 find_bin(int size) {
   return 0;	/* Should never be executed */
 }
 
+/*
+** 'share_slot' returns the entry in the shared string table where
+** the search for the string at 'cp' starts
+*/
+static int32 share_slot(char *cp) {
+  uint64 hashvalue;
+  hashvalue = CAST(CAST(cp, size_t), uint64)>>3;
+  hashvalue*=0x9E3779B97F4A7C15ull;
+  return CAST(hashvalue>>32, int32) & (sharesize-1);
+}
+
+/*
+** 'find_shared' returns the shared string table entry for the string
+** at 'cp' or NIL if the string is not shared
+*/
+static sharedstring *find_shared(char *cp) {
+  int32 n;
+  if (shareused==0) return NIL;
+  n = share_slot(cp);
+  while (sharetable[n].shareaddr!=NIL) {
+    if (sharetable[n].shareaddr==cp) return &sharetable[n];
+    n = (n+1) & (sharesize-1);
+  }
+  return NIL;
+}
+
+/*
+** 'grow_sharetable' doubles the size of the shared string table. It
+** returns FALSE if there is not enough memory to do this
+*/
+static boolean grow_sharetable(void) {
+  sharedstring *oldtable;
+  int32 oldsize, n, slot;
+  oldtable = sharetable;
+  oldsize = sharesize;
+  sharetable = calloc(oldsize==0 ? SHAREMINSIZE : oldsize*2, sizeof(sharedstring));
+  if (sharetable==NIL) {
+    sharetable = oldtable;
+    return FALSE;
+  }
+  sharesize = oldsize==0 ? SHAREMINSIZE : oldsize*2;
+  for (n=0; n<oldsize; n++) {
+    if (oldtable[n].shareaddr!=NIL) {
+      slot = share_slot(oldtable[n].shareaddr);
+      while (sharetable[slot].shareaddr!=NIL) slot = (slot+1) & (sharesize-1);
+      sharetable[slot] = oldtable[n];
+    }
+  }
+  free(oldtable);
+  return TRUE;
+}
+
+/*
+** 'release_shared' is called when one of the owners of the string at
+** 'cp' no longer wants it. It returns TRUE if the string is shared, in
+** which case it still has at least one owner and must not be freed.
+** Entries after the one removed are moved back so that no gaps are left
+** in the middle of a search sequence
+*/
+static boolean release_shared(char *cp) {
+  sharedstring *sp;
+  int32 n, next, home;
+  sp = find_shared(cp);
+  if (sp==NIL) return FALSE;
+  sp->sharecount-=1;
+  if (sp->sharecount>1) return TRUE;
+  shareused-=1;
+  n = next = sp-sharetable;
+  while (TRUE) {
+    next = (next+1) & (sharesize-1);
+    if (sharetable[next].shareaddr==NIL) break;
+    home = share_slot(sharetable[next].shareaddr);
+    if (n<next ? (home<=n || home>next) : (home<=n && home>next)) {
+      sharetable[n] = sharetable[next];
+      n = next;
+    }
+  }
+  sharetable[n].shareaddr = NIL;
+  return TRUE;
+}
+
+/*
+** 'char_string' returns a descriptor for the single character
+** string 'ch'
+*/
+basicstring char_string(int32 ch) {
+  basicstring descriptor;
+  ch = ch & BYTEMASK;
+  charstrings[ch] = ch;
+  descriptor.stringlen = 1;
+  descriptor.stringaddr = &charstrings[ch];
+  return descriptor;
+}
+
+/*
+** 'share_string' adds another owner to the string 'descriptor' and
+** returns the descriptor the new owner should use. This is the same
+** string unless the shared string table is full and cannot be extended,
+** in which case it is a copy of it
+*/
+basicstring share_string(basicstring descriptor) {
+  sharedstring *sp;
+  int32 n;
+  char *cp;
+  if (descriptor.stringlen==0 || ISCHARSTRING(descriptor.stringaddr)) return descriptor;
+  sp = find_shared(descriptor.stringaddr);
+  if (sp!=NIL) {
+    sp->sharecount+=1;
+    return descriptor;
+  }
+  if ((shareused+1)*2>sharesize && !grow_sharetable()) {	/* Cannot share it - Make a copy */
+    cp = alloc_string(descriptor.stringlen);
+    memmove(cp, descriptor.stringaddr, descriptor.stringlen);
+    descriptor.stringaddr = cp;
+    return descriptor;
+  }
+  n = share_slot(descriptor.stringaddr);
+  while (sharetable[n].shareaddr!=NIL) n = (n+1) & (sharesize-1);
+  sharetable[n].shareaddr = descriptor.stringaddr;
+  sharetable[n].sharecount = 2;
+  shareused+=1;
+  return descriptor;
+}
+
 /*
 ** 'alloc_string' is called to allocate memory for a string. The
 ** function returns a pointer to the memory allocated. Note that
@@ -248,6 +404,8 @@ void free_string(basicstring descriptor) {
    descriptor.stringaddr, size);
 #endif
   if (size==0) return;	/* Null string - Nothing to return */
+  if (size==1 && ISCHARSTRING(descriptor.stringaddr)) return;	/* Single character strings are not on the heap */
+  if (shareused>0 && release_shared(descriptor.stringaddr)) return;	/* String has other owners */
   hp = CAST(descriptor.stringaddr, heapblock *);
   bin = find_bin(size);
   hp2 = binlists[bin];
@@ -296,12 +454,22 @@ void discard_strings(byte *base, int32 size) {
 ** string is being truncated. Depending on the difference, either a new
 ** block will be allocated for the string or the old string will be
 ** returned with the extra bit 'cut off'. The spare block will be
-** added to the relevant bin
+** added to the relevant bin.
+** If the string is shared or is a single character string that is not on
+** the heap, a new copy of it is always made, so calling
+** this function with 'newlen' equal to 'oldlen' gives the caller a copy
+** of the string that it can change
 */
 char *resize_string(char *cp, int32 oldlen, int32 newlen) {
   int32 oldbin, newbin, sizediff;
   char *newcp;
   basicstring descriptor;
+  if (ISCHARSTRING(cp) || (shareused>0 && find_shared(cp)!=NIL)) {	/* String is shared - Give this owner a copy */
+    newcp = alloc_string(newlen);
+    if (newlen>0) memmove(newcp, cp, newlen<oldlen ? newlen : oldlen);
+    release_shared(cp);
+    return newcp;
+  }
   oldbin = find_bin(oldlen);
   newbin = find_bin(newlen);
   if (newbin==oldbin) return cp;	/* Can use same string */
@@ -347,6 +515,14 @@ char *resize_string(char *cp, int32 oldlen, int32 newlen) {
   }
 }
 
+/*
+** 'string_fits' returns TRUE if a string of length 'newlen' can be held
+** in the memory allocated for a string of length 'oldlen' as it is
+*/
+boolean string_fits(int32 oldlen, int32 newlen) {
+  return find_bin(oldlen)==find_bin(newlen);
+}
+
 /*
 ** 'get_stringlen' returns the length of a '$<addr>' type string. If no
 ** 'CR' character is found before the maximum allowed string length, the
@@ -370,6 +546,8 @@ void clear_strings(void) {
   for (n=0; n<BINCOUNT; n++) binlists[n] = NIL;
   freestrings = 0;
   freelist = NIL;
+  if (shareused>0) memset(sharetable, 0, sharesize*sizeof(sharedstring));
+  shareused = 0;
 #ifdef DEBUG
   allocated = 0;
   for (n=0; n<BINCOUNT; n++) allocations[n] = created[n] = reused[n] = 0;
@@ -33,8 +33,11 @@
 
 extern void *alloc_string(int32);
 extern void free_string(basicstring);
+extern basicstring share_string(basicstring);
+extern basicstring char_string(int32);
 extern void discard_strings(byte *, int32);
 extern char *resize_string(char *, int32, int32);
+extern boolean string_fits(int32, int32);
 extern void clear_strings(void);
 extern int32 get_stringlen(int32);
 extern void show_stringstats(void);
@@ -151,70 +151,74 @@ static token tokens [] = {
   {"DEG",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_DEG,      TYPE_FUNCTION, BASIC_TOKEN_DEG,       FALSE,  FALSE},
   {"DIM",       3, 3, TYPE_ONEBYTE,     BASIC_TOKEN_DIM,      TYPE_ONEBYTE, BASIC_TOKEN_DIM,        FALSE,  FALSE},
   {"DIV",       3, 2, TYPE_ONEBYTE,     BASIC_TOKEN_DIV,      TYPE_ONEBYTE, BASIC_TOKEN_DIV,        FALSE,  FALSE},
+  {"DOT(",      4, 4, TYPE_FUNCTION,    BASIC_TOKEN_DOT,      TYPE_FUNCTION, BASIC_TOKEN_DOT,       FALSE,  FALSE},
   {"DRAWBY",    6, 5, TYPE_ONEBYTE,     BASIC_TOKEN_DRAWBY,   TYPE_ONEBYTE, BASIC_TOKEN_DRAWBY,     FALSE,  FALSE},
   {"DRAW",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_DRAW,     TYPE_ONEBYTE, BASIC_TOKEN_DRAW,       FALSE,  FALSE},
-  {"ELLIPSE",   7, 3, TYPE_ONEBYTE,     BASIC_TOKEN_ELLIPSE,  TYPE_ONEBYTE, BASIC_TOKEN_ELLIPSE,    FALSE,  FALSE}, /* 33 */
+  {"ELLIPSE",   7, 3, TYPE_ONEBYTE,     BASIC_TOKEN_ELLIPSE,  TYPE_ONEBYTE, BASIC_TOKEN_ELLIPSE,    FALSE,  FALSE}, /* 34 */
   {"ELSE",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_XELSE,    TYPE_ONEBYTE, BASIC_TOKEN_XELSE,      FALSE,  TRUE},
   {"ENDCASE",   7, 4, TYPE_ONEBYTE,     BASIC_TOKEN_ENDCASE,  TYPE_ONEBYTE, BASIC_TOKEN_ENDCASE,    TRUE,   FALSE},
   {"ENDIF",     5, 4, TYPE_ONEBYTE,     BASIC_TOKEN_ENDIF,    TYPE_ONEBYTE, BASIC_TOKEN_ENDIF,      TRUE,   FALSE},
   {"ENDPROC",   7, 1, TYPE_ONEBYTE,     BASIC_TOKEN_ENDPROC,  TYPE_ONEBYTE, BASIC_TOKEN_ENDPROC,    TRUE,   FALSE},
-  {"ENDWHILE",  8, 4, TYPE_ONEBYTE,     BASIC_TOKEN_ENDWHILE, TYPE_ONEBYTE, BASIC_TOKEN_ENDWHILE,   TRUE,   FALSE}, /* 38 */
+  {"ENDWHILE",  8, 4, TYPE_ONEBYTE,     BASIC_TOKEN_ENDWHILE, TYPE_ONEBYTE, BASIC_TOKEN_ENDWHILE,   TRUE,   FALSE}, /* 39 */
   {"END",       3, 3, TYPE_ONEBYTE,     BASIC_TOKEN_END,      TYPE_ONEBYTE, BASIC_TOKEN_END,        TRUE,   FALSE},
   {"ENVELOPE",  8, 3, TYPE_ONEBYTE,     BASIC_TOKEN_ENVELOPE, TYPE_ONEBYTE, BASIC_TOKEN_ENVELOPE,   FALSE,  FALSE},
   {"EOF",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_EOF,      TYPE_FUNCTION, BASIC_TOKEN_EOF,       TRUE,   FALSE},
   {"EOR",       3, 3, TYPE_ONEBYTE,     BASIC_TOKEN_EOR,      TYPE_ONEBYTE, BASIC_TOKEN_EOR,        FALSE,  FALSE},
-  {"ERL",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_ERL,      TYPE_FUNCTION, BASIC_TOKEN_ERL,       TRUE,   FALSE}, /* 43 */
+  {"ERL",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_ERL,      TYPE_FUNCTION, BASIC_TOKEN_ERL,       TRUE,   FALSE}, /* 44 */
   {"ERROR",     5, 3, TYPE_ONEBYTE,     BASIC_TOKEN_ERROR,    TYPE_ONEBYTE, BASIC_TOKEN_ERROR,      FALSE,  FALSE},
   {"ERR",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_ERR,      TYPE_FUNCTION, BASIC_TOKEN_ERR,       TRUE,   FALSE},
   {"EVAL",      4, 2, TYPE_FUNCTION,    BASIC_TOKEN_EVAL,     TYPE_FUNCTION, BASIC_TOKEN_EVAL,      FALSE,  FALSE},
   {"EXP",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_EXP,      TYPE_FUNCTION, BASIC_TOKEN_EXP,       FALSE,  FALSE},
   {"EXT",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_EXT,      TYPE_FUNCTION, BASIC_TOKEN_EXT,       TRUE,   FALSE},
-  {"FALSE",     5, 2, TYPE_ONEBYTE,     BASIC_TOKEN_FALSE,    TYPE_ONEBYTE, BASIC_TOKEN_FALSE,      TRUE,   FALSE}, /* 49 */
+  {"FALSE",     5, 2, TYPE_ONEBYTE,     BASIC_TOKEN_FALSE,    TYPE_ONEBYTE, BASIC_TOKEN_FALSE,      TRUE,   FALSE}, /* 50 */
   {"FILEPATH$", 9, 4, TYPE_FUNCTION,    BASIC_TOKEN_FILEPATH, TYPE_FUNCTION, BASIC_TOKEN_FILEPATH,  FALSE,  FALSE},
   {"FILL",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_FILL,     TYPE_ONEBYTE, BASIC_TOKEN_FILL,       FALSE,  FALSE},
   {"FN",        2, 2, TYPE_ONEBYTE,     BASIC_TOKEN_FN,       TYPE_ONEBYTE, BASIC_TOKEN_FN,         FALSE,  FALSE},
   {"FOR",       3, 1, TYPE_ONEBYTE,     BASIC_TOKEN_FOR,      TYPE_ONEBYTE, BASIC_TOKEN_FOR,        FALSE,  FALSE},
-  {"GCOL",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_GCOL,     TYPE_ONEBYTE, BASIC_TOKEN_GCOL,       FALSE,  FALSE}, /* 54 */
+  {"GCOL",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_GCOL,     TYPE_ONEBYTE, BASIC_TOKEN_GCOL,       FALSE,  FALSE}, /* 55 */
   {"GET$",      4, 2, TYPE_FUNCTION,    BASIC_TOKEN_GETDOL,   TYPE_FUNCTION, BASIC_TOKEN_GETDOL,    FALSE,  FALSE},
   {"GET",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_GET,      TYPE_FUNCTION, BASIC_TOKEN_GET,       FALSE,  FALSE},
   {"GOSUB",     5, 3, TYPE_ONEBYTE,     BASIC_TOKEN_GOSUB,    TYPE_ONEBYTE, BASIC_TOKEN_GOSUB,      FALSE,  TRUE},
   {"GOTO",      4, 1, TYPE_ONEBYTE,     BASIC_TOKEN_GOTO,     TYPE_ONEBYTE, BASIC_TOKEN_GOTO,       FALSE,  TRUE},
-  {"HIMEM",     5, 1, TYPE_FUNCTION,    BASIC_TOKEN_HIMEM,    TYPE_FUNCTION, BASIC_TOKEN_HIMEM,     TRUE,   FALSE}, /* 59 */
-  {"IF",        2, 2, TYPE_ONEBYTE,     BASIC_TOKEN_XIF,      TYPE_ONEBYTE, BASIC_TOKEN_XIF,        FALSE,  FALSE}, /* 60 */
+  {"HIMEM",     5, 1, TYPE_FUNCTION,    BASIC_TOKEN_HIMEM,    TYPE_FUNCTION, BASIC_TOKEN_HIMEM,     TRUE,   FALSE}, /* 60 */
+  {"IF",        2, 2, TYPE_ONEBYTE,     BASIC_TOKEN_XIF,      TYPE_ONEBYTE, BASIC_TOKEN_XIF,        FALSE,  FALSE}, /* 61 */
   {"INKEY$",    6, 3, TYPE_FUNCTION,    BASIC_TOKEN_INKEYDOL, TYPE_FUNCTION, BASIC_TOKEN_INKEYDOL,  FALSE, FALSE},
   {"INKEY",     5, 5, TYPE_FUNCTION,    BASIC_TOKEN_INKEY,    TYPE_FUNCTION, BASIC_TOKEN_INKEY,     FALSE,  FALSE},
   {"INPUT",     5, 1, TYPE_ONEBYTE,     BASIC_TOKEN_INPUT,    TYPE_ONEBYTE, BASIC_TOKEN_INPUT,      FALSE,  FALSE},
   {"INSTR(",    6, 3, TYPE_FUNCTION,    BASIC_TOKEN_INSTR,    TYPE_FUNCTION, BASIC_TOKEN_INSTR,     FALSE,  FALSE},
   {"INT",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_INT,      TYPE_FUNCTION, BASIC_TOKEN_INT,       FALSE,  FALSE},
-  {"LEFT$(",    6, 2, TYPE_FUNCTION,    BASIC_TOKEN_LEFT,     TYPE_FUNCTION, BASIC_TOKEN_LEFT,      FALSE,  FALSE}, /* 66 */
+  {"LEFT$(",    6, 2, TYPE_FUNCTION,    BASIC_TOKEN_LEFT,     TYPE_FUNCTION, BASIC_TOKEN_LEFT,      FALSE,  FALSE}, /* 67 */
   {"LEN",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_LEN,      TYPE_FUNCTION, BASIC_TOKEN_LEN,       FALSE,  FALSE},
   {"LET",       3, 3, TYPE_ONEBYTE,     BASIC_TOKEN_LET,      TYPE_ONEBYTE, BASIC_TOKEN_LET,        FALSE,  FALSE},
-  {"LIBRARY",   7, 3, TYPE_ONEBYTE,     BASIC_TOKEN_LIBRARY,  TYPE_ONEBYTE, BASIC_TOKEN_LIBRARY,    FALSE,  FALSE}, /* 69 */
+  {"LIBRARY",   7, 3, TYPE_ONEBYTE,     BASIC_TOKEN_LIBRARY,  TYPE_ONEBYTE, BASIC_TOKEN_LIBRARY,    FALSE,  FALSE}, /* 70 */
   {"LINE",      4, 3, TYPE_ONEBYTE,     BASIC_TOKEN_LINE,     TYPE_ONEBYTE, BASIC_TOKEN_LINE,       FALSE,  FALSE},
   {"LN",        2, 2, TYPE_FUNCTION,    BASIC_TOKEN_LN,       TYPE_FUNCTION, BASIC_TOKEN_LN,        FALSE,  FALSE},
   {"LOCAL",     5, 3, TYPE_ONEBYTE,     BASIC_TOKEN_LOCAL,    TYPE_ONEBYTE, BASIC_TOKEN_LOCAL,      FALSE,  FALSE},
   {"LOG",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_LOG,      TYPE_FUNCTION, BASIC_TOKEN_LOG,       FALSE,  FALSE},
   {"LOMEM",     5, 3, TYPE_FUNCTION,    BASIC_TOKEN_LOMEM,    TYPE_FUNCTION, BASIC_TOKEN_LOMEM,     TRUE,   FALSE},
-  {"MID$(",     5, 1, TYPE_FUNCTION,    BASIC_TOKEN_MID,      TYPE_FUNCTION, BASIC_TOKEN_MID,       FALSE,  FALSE}, /* 75 */
+  {"MAX(",      4, 4, TYPE_FUNCTION,    BASIC_TOKEN_MAX,      TYPE_FUNCTION, BASIC_TOKEN_MAX,       FALSE,  FALSE}, /* 76 */
+  {"MEAN(",     5, 5, TYPE_FUNCTION,    BASIC_TOKEN_MEAN,     TYPE_FUNCTION, BASIC_TOKEN_MEAN,      FALSE,  FALSE},
+  {"MID$(",     5, 1, TYPE_FUNCTION,    BASIC_TOKEN_MID,      TYPE_FUNCTION, BASIC_TOKEN_MID,       FALSE,  FALSE},
+  {"MIN(",      4, 4, TYPE_FUNCTION,    BASIC_TOKEN_MIN,      TYPE_FUNCTION, BASIC_TOKEN_MIN,       FALSE,  FALSE},
   {"MODE",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_MODE,     TYPE_ONEBYTE, BASIC_TOKEN_MODE,       FALSE,  FALSE},
   {"MOD",       3, 3, TYPE_ONEBYTE,     BASIC_TOKEN_MOD,      TYPE_ONEBYTE, BASIC_TOKEN_MOD,        FALSE,  FALSE},
   {"MOUSE",     5, 3, TYPE_ONEBYTE,     BASIC_TOKEN_MOUSE,    TYPE_ONEBYTE, BASIC_TOKEN_MOUSE,      FALSE,  FALSE},
   {"MOVEBY",    6, 6, TYPE_ONEBYTE,     BASIC_TOKEN_MOVEBY,   TYPE_ONEBYTE, BASIC_TOKEN_MOVEBY,     FALSE,  FALSE},
   {"MOVE",      4, 3, TYPE_ONEBYTE,     BASIC_TOKEN_MOVE,     TYPE_ONEBYTE, BASIC_TOKEN_MOVE,       FALSE,  FALSE},
-  {"NEXT",      4, 1, TYPE_ONEBYTE,     BASIC_TOKEN_NEXT,     TYPE_ONEBYTE, BASIC_TOKEN_NEXT,       FALSE,  FALSE}, /* 81 */
+  {"NEXT",      4, 1, TYPE_ONEBYTE,     BASIC_TOKEN_NEXT,     TYPE_ONEBYTE, BASIC_TOKEN_NEXT,       FALSE,  FALSE}, /* 85 */
   {"NOT",       3, 3, TYPE_ONEBYTE,     BASIC_TOKEN_NOT,      TYPE_ONEBYTE, BASIC_TOKEN_NOT,        FALSE,  FALSE},
-  {"OFF",       3, 3, TYPE_ONEBYTE,     BASIC_TOKEN_OFF,      TYPE_ONEBYTE, BASIC_TOKEN_OFF,        FALSE,  FALSE}, /* 83 */
+  {"OFF",       3, 3, TYPE_ONEBYTE,     BASIC_TOKEN_OFF,      TYPE_ONEBYTE, BASIC_TOKEN_OFF,        FALSE,  FALSE}, /* 87 */
   {"OF",        2, 2, TYPE_ONEBYTE,     BASIC_TOKEN_OF,       TYPE_ONEBYTE, BASIC_TOKEN_OF,         FALSE,  FALSE},
-  {"ON",        2, 2, TYPE_ONEBYTE,     BASIC_TOKEN_ON,       TYPE_ONEBYTE, BASIC_TOKEN_ON,         FALSE,  FALSE}, /* 85 */
+  {"ON",        2, 2, TYPE_ONEBYTE,     BASIC_TOKEN_ON,       TYPE_ONEBYTE, BASIC_TOKEN_ON,         FALSE,  FALSE}, /* 89 */
   {"OPENIN",    6, 2, TYPE_FUNCTION,    BASIC_TOKEN_OPENIN,   TYPE_FUNCTION, BASIC_TOKEN_OPENIN,    FALSE,  FALSE},
   {"OPENOUT",   7, 5, TYPE_FUNCTION,    BASIC_TOKEN_OPENOUT,  TYPE_FUNCTION, BASIC_TOKEN_OPENOUT,   FALSE,  FALSE},
   {"OPENUP",    6, 5, TYPE_FUNCTION,    BASIC_TOKEN_OPENUP,   TYPE_FUNCTION, BASIC_TOKEN_OPENUP,    FALSE,  FALSE},
   {"ORIGIN",    6, 2, TYPE_ONEBYTE,     BASIC_TOKEN_ORIGIN,   TYPE_ONEBYTE, BASIC_TOKEN_ORIGIN,     FALSE,  FALSE},
-  {"OR",        2, 2, TYPE_ONEBYTE,     BASIC_TOKEN_OR,       TYPE_ONEBYTE, BASIC_TOKEN_OR,         FALSE,  FALSE}, /* 90 */
+  {"OR",        2, 2, TYPE_ONEBYTE,     BASIC_TOKEN_OR,       TYPE_ONEBYTE, BASIC_TOKEN_OR,         FALSE,  FALSE}, /* 94 */
   {"OSCLI",     5, 2, TYPE_ONEBYTE,     BASIC_TOKEN_OSCLI,    TYPE_ONEBYTE, BASIC_TOKEN_OSCLI,      FALSE,  FALSE},
   {"OTHERWISE", 9, 2, TYPE_ONEBYTE,     BASIC_TOKEN_XOTHERWISE, TYPE_ONEBYTE, BASIC_TOKEN_XOTHERWISE, FALSE, FALSE},
   {"OVERLAY",   7, 2, TYPE_ONEBYTE,     BASIC_TOKEN_OVERLAY,  TYPE_ONEBYTE,   BASIC_TOKEN_OVERLAY,  FALSE,  FALSE},
-  {"PAGE",      4, 2, TYPE_FUNCTION,    BASIC_TOKEN_PAGE,     TYPE_FUNCTION, BASIC_TOKEN_PAGE,      TRUE,   FALSE}, /* 94 */
+  {"PAGE",      4, 2, TYPE_FUNCTION,    BASIC_TOKEN_PAGE,     TYPE_FUNCTION, BASIC_TOKEN_PAGE,      TRUE,   FALSE}, /* 98 */
   {"PI",        2, 2, TYPE_FUNCTION,    BASIC_TOKEN_PI,       TYPE_FUNCTION, BASIC_TOKEN_PI,        TRUE,   FALSE},
   {"PLOT",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_PLOT,     TYPE_ONEBYTE, BASIC_TOKEN_PLOT,       FALSE,  FALSE},
   {"POINTTO",   7, 7, TYPE_ONEBYTE,     BASIC_TOKEN_POINTTO,  TYPE_ONEBYTE, BASIC_TOKEN_POINTTO,    FALSE,  FALSE},
@@ -222,73 +226,75 @@ static token tokens [] = {
   {"POINT(",    6, 2, TYPE_FUNCTION,    BASIC_TOKEN_POINTFN,  TYPE_FUNCTION, BASIC_TOKEN_POINTFN,   FALSE,  FALSE},
   {"POINT",     5, 5, TYPE_ONEBYTE,     BASIC_TOKEN_POINT,    TYPE_ONEBYTE, BASIC_TOKEN_POINT,      FALSE,  FALSE},
   {"POS",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_POS,      TYPE_FUNCTION, BASIC_TOKEN_POS,       TRUE,   FALSE},
-  {"PRINT",     5, 1, TYPE_ONEBYTE,     BASIC_TOKEN_PRINT,    TYPE_ONEBYTE, BASIC_TOKEN_PRINT,      FALSE,  FALSE}, /* 102 */
+  {"PRINT",     5, 1, TYPE_ONEBYTE,     BASIC_TOKEN_PRINT,    TYPE_ONEBYTE, BASIC_TOKEN_PRINT,      FALSE,  FALSE}, /* 106 */
   {"PROC",      4, 4, TYPE_ONEBYTE,     BASIC_TOKEN_PROC,     TYPE_ONEBYTE, BASIC_TOKEN_PROC,       FALSE,  FALSE},
   {"PTR",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_PTR,      TYPE_FUNCTION, BASIC_TOKEN_PTR,       TRUE,   FALSE},
-  {"QUIT",      4, 1, TYPE_ONEBYTE,     BASIC_TOKEN_QUIT,     TYPE_ONEBYTE, BASIC_TOKEN_QUIT,       TRUE,   FALSE}, /* 105 */
-  {"RAD",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_RAD,      TYPE_FUNCTION, BASIC_TOKEN_RAD,       FALSE,  FALSE}, /* 106 */
+  {"QUIT",      4, 1, TYPE_ONEBYTE,     BASIC_TOKEN_QUIT,     TYPE_ONEBYTE, BASIC_TOKEN_QUIT,       TRUE,   FALSE}, /* 109 */
+  {"RAD",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_RAD,      TYPE_FUNCTION, BASIC_TOKEN_RAD,       FALSE,  FALSE}, /* 110 */
   {"READ",      4, 3, TYPE_ONEBYTE,     BASIC_TOKEN_READ,     TYPE_ONEBYTE, BASIC_TOKEN_READ,       FALSE,  FALSE},
   {"RECTANGLE", 9, 3, TYPE_ONEBYTE,     BASIC_TOKEN_RECTANGLE, TYPE_ONEBYTE, BASIC_TOKEN_RECTANGLE, FALSE,  FALSE},
   {"REM",       3, 3, TYPE_ONEBYTE,     BASIC_TOKEN_REM,      TYPE_ONEBYTE, BASIC_TOKEN_REM,        FALSE,  FALSE},
   {"REPEAT",    6, 3, TYPE_ONEBYTE,     BASIC_TOKEN_REPEAT,   TYPE_ONEBYTE, BASIC_TOKEN_REPEAT,     FALSE,  FALSE},
   {"REPORT$",   7, 7, TYPE_FUNCTION,    BASIC_TOKEN_REPORTDOL, TYPE_FUNCTION, BASIC_TOKEN_REPORTDOL, FALSE, FALSE},
-  {"REPORT",    6, 4, TYPE_ONEBYTE,     BASIC_TOKEN_REPORT,   TYPE_ONEBYTE, BASIC_TOKEN_REPORT,     TRUE,   FALSE}, /* 112 */
+  {"REPORT",    6, 4, TYPE_ONEBYTE,     BASIC_TOKEN_REPORT,   TYPE_ONEBYTE, BASIC_TOKEN_REPORT,     TRUE,   FALSE}, /* 116 */
   {"RESTORE",   7, 3, TYPE_ONEBYTE,     BASIC_TOKEN_RESTORE,  TYPE_ONEBYTE, BASIC_TOKEN_RESTORE,    FALSE,  TRUE},
   {"RETURN",    6, 1, TYPE_ONEBYTE,     BASIC_TOKEN_RETURN,   TYPE_ONEBYTE, BASIC_TOKEN_RETURN,     TRUE,   FALSE},
   {"RIGHT$(",   7, 2, TYPE_FUNCTION,    BASIC_TOKEN_RIGHT,    TYPE_FUNCTION, BASIC_TOKEN_RIGHT,     FALSE,  FALSE},
   {"RND",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_RND,      TYPE_FUNCTION, BASIC_TOKEN_RND,       TRUE,   FALSE},
   {"RUN",       3, 2, TYPE_ONEBYTE,     BASIC_TOKEN_RUN,      TYPE_ONEBYTE, BASIC_TOKEN_RUN,        TRUE,   FALSE},
-  {"SGN",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_SGN,      TYPE_FUNCTION, BASIC_TOKEN_SGN,       FALSE,  FALSE}, /* 118 */
+  {"SGN",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_SGN,      TYPE_FUNCTION, BASIC_TOKEN_SGN,       FALSE,  FALSE}, /* 122 */
   {"SIN",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_SIN,      TYPE_FUNCTION, BASIC_TOKEN_SIN,       FALSE,  FALSE},
   {"SOUND",     5, 2, TYPE_ONEBYTE,     BASIC_TOKEN_SOUND,    TYPE_ONEBYTE, BASIC_TOKEN_SOUND,      FALSE,  FALSE},
   {"SPC",       3, 3, TYPE_PRINTFN,     BASIC_TOKEN_SPC,      TYPE_PRINTFN, BASIC_TOKEN_SPC,        FALSE,  FALSE},
-  {"SQR",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_SQR,      TYPE_FUNCTION, BASIC_TOKEN_SQR,       FALSE,  FALSE}, /* 122 */
+  {"SPLIT(",    6, 3, TYPE_FUNCTION,    BASIC_TOKEN_SPLIT,    TYPE_FUNCTION, BASIC_TOKEN_SPLIT,     FALSE,  FALSE},
+  {"SQR",       3, 3, TYPE_FUNCTION,    BASIC_TOKEN_SQR,      TYPE_FUNCTION, BASIC_TOKEN_SQR,       FALSE,  FALSE}, /* 127 */
   {"STEP",      4, 1, TYPE_ONEBYTE,     BASIC_TOKEN_STEP,     TYPE_ONEBYTE, BASIC_TOKEN_STEP,       FALSE,  FALSE},
   {"STEREO",    6, 4, TYPE_ONEBYTE,     BASIC_TOKEN_STEREO,   TYPE_ONEBYTE, BASIC_TOKEN_STEREO,     FALSE,  FALSE},
   {"STOP",      4, 3, TYPE_ONEBYTE,     BASIC_TOKEN_STOP,     TYPE_ONEBYTE, BASIC_TOKEN_STOP,       TRUE,   FALSE},
   {"STR$",      4, 3, TYPE_FUNCTION,    BASIC_TOKEN_STR,      TYPE_FUNCTION, BASIC_TOKEN_STR,       FALSE,  FALSE},
-  {"STRING$(",  8, 4, TYPE_FUNCTION,    BASIC_TOKEN_STRING,   TYPE_FUNCTION, BASIC_TOKEN_STRING,    FALSE,  FALSE}, /* 127 */
+  {"STRING$(",  8, 4, TYPE_FUNCTION,    BASIC_TOKEN_STRING,   TYPE_FUNCTION, BASIC_TOKEN_STRING,    FALSE,  FALSE}, /* 132 */
   {"SUM",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_SUM,      TYPE_FUNCTION, BASIC_TOKEN_SUM,       FALSE,  FALSE},
   {"SWAP",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_SWAP,     TYPE_ONEBYTE, BASIC_TOKEN_SWAP,       FALSE,  FALSE},
   {"SYS",       3, 2, TYPE_ONEBYTE,     BASIC_TOKEN_SYS,      TYPE_ONEBYTE, BASIC_TOKEN_SYS,        FALSE,  FALSE},
-  {"TAB(",      4, 4, TYPE_PRINTFN,     BASIC_TOKEN_TAB,      TYPE_PRINTFN, BASIC_TOKEN_TAB,        FALSE,  FALSE}, /* 131 */
+  {"TAB(",      4, 4, TYPE_PRINTFN,     BASIC_TOKEN_TAB,      TYPE_PRINTFN, BASIC_TOKEN_TAB,        FALSE,  FALSE}, /* 136 */
   {"TAN",       3, 1, TYPE_FUNCTION,    BASIC_TOKEN_TAN,      TYPE_FUNCTION, BASIC_TOKEN_TAN,       FALSE,  FALSE},
   {"TEMPO",     5, 2, TYPE_ONEBYTE,     BASIC_TOKEN_TEMPO,    TYPE_FUNCTION, BASIC_TOKEN_TEMPOFN,   FALSE,  FALSE},
   {"THEN",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_THEN,     TYPE_ONEBYTE, BASIC_TOKEN_THEN,       FALSE,  TRUE},
   {"TIME$",     5, 5, TYPE_FUNCTION,    BASIC_TOKEN_TIMEDOL,  TYPE_FUNCTION, BASIC_TOKEN_TIMEDOL,   TRUE,   FALSE},
   {"TIME",      4, 2, TYPE_FUNCTION,    BASIC_TOKEN_TIME,     TYPE_FUNCTION, BASIC_TOKEN_TIME,      TRUE,   FALSE},
-  {"TINT",      4, 3, TYPE_ONEBYTE,     BASIC_TOKEN_TINT,     TYPE_ONEBYTE, BASIC_TOKEN_TINT,       FALSE,  FALSE}, /* 137 */
+  {"TINT",      4, 3, TYPE_ONEBYTE,     BASIC_TOKEN_TINT,     TYPE_ONEBYTE, BASIC_TOKEN_TINT,       FALSE,  FALSE}, /* 142 */
   {"TO",        2, 3, TYPE_ONEBYTE,     BASIC_TOKEN_TO,       TYPE_ONEBYTE, BASIC_TOKEN_TO,         FALSE,  FALSE},
   {"TRACE",     5, 2, TYPE_ONEBYTE,     BASIC_TOKEN_TRACE,    TYPE_ONEBYTE, BASIC_TOKEN_TRACE,      FALSE,  FALSE},
   {"TRUE",      4, 3, TYPE_ONEBYTE,     BASIC_TOKEN_TRUE,     TYPE_ONEBYTE, BASIC_TOKEN_TRUE,       TRUE,   FALSE},
-  {"UNTIL",     5, 1, TYPE_ONEBYTE,     BASIC_TOKEN_UNTIL,    TYPE_ONEBYTE, BASIC_TOKEN_UNTIL,      FALSE,  FALSE}, /* 141 */
+  {"UNTIL",     5, 1, TYPE_ONEBYTE,     BASIC_TOKEN_UNTIL,    TYPE_ONEBYTE, BASIC_TOKEN_UNTIL,      FALSE,  FALSE}, /* 146 */
   {"USR",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_USR,      TYPE_FUNCTION, BASIC_TOKEN_USR,       FALSE,  FALSE},
-  {"VAL",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_VAL,      TYPE_FUNCTION, BASIC_TOKEN_VAL,       FALSE,  FALSE}, /* 143 */
+  {"VAL",       3, 2, TYPE_FUNCTION,    BASIC_TOKEN_VAL,      TYPE_FUNCTION, BASIC_TOKEN_VAL,       FALSE,  FALSE}, /* 148 */
+  {"VARIANCE(", 9, 9, TYPE_FUNCTION,    BASIC_TOKEN_VARIANCE, TYPE_FUNCTION, BASIC_TOKEN_VARIANCE,  FALSE,  FALSE},
   {"VDU",       3, 1, TYPE_ONEBYTE,     BASIC_TOKEN_VDU,      TYPE_ONEBYTE, BASIC_TOKEN_VDU,        FALSE,  FALSE},
   {"VERIFY(",   7, 2, TYPE_FUNCTION,    BASIC_TOKEN_VERIFY,   TYPE_FUNCTION, BASIC_TOKEN_VERIFY,    FALSE,  FALSE},
   {"VOICES",    6, 2, TYPE_ONEBYTE,     BASIC_TOKEN_VOICES,   TYPE_ONEBYTE, BASIC_TOKEN_VOICES,     FALSE,  FALSE},
   {"VOICE",     5, 5, TYPE_ONEBYTE,     BASIC_TOKEN_VOICE,    TYPE_ONEBYTE, BASIC_TOKEN_VOICE,      FALSE,  FALSE},
   {"VPOS",      4, 2, TYPE_FUNCTION,    BASIC_TOKEN_VPOS,     TYPE_FUNCTION, BASIC_TOKEN_VPOS,      TRUE,   FALSE},
-  {"WAIT",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_WAIT,     TYPE_ONEBYTE, BASIC_TOKEN_WAIT,       TRUE,   FALSE}, /* 149 */
+  {"WAIT",      4, 2, TYPE_ONEBYTE,     BASIC_TOKEN_WAIT,     TYPE_ONEBYTE, BASIC_TOKEN_WAIT,       TRUE,   FALSE}, /* 155 */
   {"WHEN",      4, 3, TYPE_ONEBYTE,     BASIC_TOKEN_XWHEN,    TYPE_ONEBYTE, BASIC_TOKEN_XWHEN,      FALSE,  FALSE},
   {"WHILE",     5, 1, TYPE_ONEBYTE,     BASIC_TOKEN_XWHILE,   TYPE_ONEBYTE, BASIC_TOKEN_XWHILE,     FALSE,  FALSE},
   {"WIDTH",     5, 2, TYPE_ONEBYTE,     BASIC_TOKEN_WIDTH,    TYPE_ONEBYTE, BASIC_TOKEN_WIDTH,      FALSE,  FALSE},
-  {"XLATE$(",   7, 2, TYPE_FUNCTION,    BASIC_TOKEN_XLATEDOL, TYPE_FUNCTION, BASIC_TOKEN_XLATEDOL,  FALSE,  FALSE}, /* 153 */
+  {"XLATE$(",   7, 2, TYPE_FUNCTION,    BASIC_TOKEN_XLATEDOL, TYPE_FUNCTION, BASIC_TOKEN_XLATEDOL,  FALSE,  FALSE}, /* 159 */
 /*
 ** The following keywords are Basic commands. These can be entered in mixed case.
 ** Note that 'RUN' is also in here so that it can be entered in lower case too.
 ** Also note that in the case of commands where there is 'O' version, the
 ** 'O' version must come first, for example, EDITO must preceed EDIT
 */
-  {"APPEND",    6, 2, TYPE_COMMAND,     BASIC_TOKEN_APPEND,   TYPE_COMMAND, BASIC_TOKEN_APPEND,     FALSE,  FALSE}, /* 154 */
+  {"APPEND",    6, 2, TYPE_COMMAND,     BASIC_TOKEN_APPEND,   TYPE_COMMAND, BASIC_TOKEN_APPEND,     FALSE,  FALSE}, /* 160 */
   {"AUTO",      4, 2, TYPE_COMMAND,     BASIC_TOKEN_AUTO,     TYPE_COMMAND, BASIC_TOKEN_AUTO,       FALSE,  FALSE},
-  {"CRUNCH",    6, 2, TYPE_COMMAND,     BASIC_TOKEN_CRUNCH,   TYPE_COMMAND, BASIC_TOKEN_CRUNCH,     FALSE,  FALSE}, /* 156 */
-  {"DELETE",    6, 3, TYPE_COMMAND,     BASIC_TOKEN_DELETE,   TYPE_COMMAND, BASIC_TOKEN_DELETE,     FALSE,  FALSE}, /* 157 */
+  {"CRUNCH",    6, 2, TYPE_COMMAND,     BASIC_TOKEN_CRUNCH,   TYPE_COMMAND, BASIC_TOKEN_CRUNCH,     FALSE,  FALSE}, /* 162 */
+  {"DELETE",    6, 3, TYPE_COMMAND,     BASIC_TOKEN_DELETE,   TYPE_COMMAND, BASIC_TOKEN_DELETE,     FALSE,  FALSE}, /* 163 */
   {"EDITO",     5, 5, TYPE_COMMAND,     BASIC_TOKEN_EDITO,    TYPE_COMMAND, BASIC_TOKEN_EDITO,      FALSE,  FALSE},
-  {"EDIT",      4, 2, TYPE_COMMAND,     BASIC_TOKEN_EDIT,     TYPE_COMMAND, BASIC_TOKEN_EDIT,       FALSE,  FALSE}, /* 159 */
-  {"HELP",      4, 2, TYPE_COMMAND,     BASIC_TOKEN_HELP,     TYPE_COMMAND, BASIC_TOKEN_HELP,       TRUE,   FALSE}, /* 160 */
-  {"INSTALL",   7, 5, TYPE_COMMAND,     BASIC_TOKEN_INSTALL,  TYPE_COMMAND, BASIC_TOKEN_INSTALL,    FALSE,  FALSE}, /* 161 */
-  {"LISTB",     5, 5, TYPE_COMMAND,     BASIC_TOKEN_LISTB,    TYPE_COMMAND, BASIC_TOKEN_LISTB,      FALSE,  FALSE}, /* 162 */
+  {"EDIT",      4, 2, TYPE_COMMAND,     BASIC_TOKEN_EDIT,     TYPE_COMMAND, BASIC_TOKEN_EDIT,       FALSE,  FALSE}, /* 165 */
+  {"HELP",      4, 2, TYPE_COMMAND,     BASIC_TOKEN_HELP,     TYPE_COMMAND, BASIC_TOKEN_HELP,       TRUE,   FALSE}, /* 166 */
+  {"INSTALL",   7, 5, TYPE_COMMAND,     BASIC_TOKEN_INSTALL,  TYPE_COMMAND, BASIC_TOKEN_INSTALL,    FALSE,  FALSE}, /* 167 */
+  {"LISTB",     5, 5, TYPE_COMMAND,     BASIC_TOKEN_LISTB,    TYPE_COMMAND, BASIC_TOKEN_LISTB,      FALSE,  FALSE}, /* 168 */
   {"LISTIF",    6, 6, TYPE_COMMAND,     BASIC_TOKEN_LISTIF,   TYPE_COMMAND, BASIC_TOKEN_LISTIF,     FALSE,  FALSE},
   {"LISTL",     5, 5, TYPE_COMMAND,     BASIC_TOKEN_LISTL,    TYPE_COMMAND, BASIC_TOKEN_LISTL,      FALSE,  FALSE},
   {"LISTO",     5, 5, TYPE_COMMAND,     BASIC_TOKEN_LISTO,    TYPE_FUNCTION, BASIC_TOKEN_LISTOFN,   FALSE,  FALSE},
@@ -296,31 +302,31 @@ static token tokens [] = {
   {"LIST",      4, 1, TYPE_COMMAND,     BASIC_TOKEN_LIST,     TYPE_COMMAND, BASIC_TOKEN_LIST,       FALSE,  FALSE},
   {"LOAD",      4, 2, TYPE_COMMAND,     BASIC_TOKEN_LOAD,     TYPE_COMMAND, BASIC_TOKEN_LOAD,       FALSE,  FALSE},
   {"LVAR",      4, 3, TYPE_COMMAND,     BASIC_TOKEN_LVAR,     TYPE_COMMAND, BASIC_TOKEN_LVAR,       TRUE,   FALSE},
-  {"NEW",       3, 3, TYPE_COMMAND,     BASIC_TOKEN_NEW,      TYPE_COMMAND, BASIC_TOKEN_NEW,        TRUE,   FALSE}, /* 170 */
-  {"OLD",       3, 1, TYPE_COMMAND,     BASIC_TOKEN_OLD,      TYPE_COMMAND, BASIC_TOKEN_OLD,        TRUE,   FALSE}, /* 171 */
-  {"QUIT",      4, 1, TYPE_ONEBYTE,     BASIC_TOKEN_QUIT,     TYPE_ONEBYTE, BASIC_TOKEN_QUIT,       TRUE,   FALSE}, /* 172 */
-  {"RENUMBER",  8, 3, TYPE_COMMAND,     BASIC_TOKEN_RENUMBER, TYPE_COMMAND, BASIC_TOKEN_RENUMBER,   FALSE,  FALSE}, /* 173 */
+  {"NEW",       3, 3, TYPE_COMMAND,     BASIC_TOKEN_NEW,      TYPE_COMMAND, BASIC_TOKEN_NEW,        TRUE,   FALSE}, /* 176 */
+  {"OLD",       3, 1, TYPE_COMMAND,     BASIC_TOKEN_OLD,      TYPE_COMMAND, BASIC_TOKEN_OLD,        TRUE,   FALSE}, /* 177 */
+  {"QUIT",      4, 1, TYPE_ONEBYTE,     BASIC_TOKEN_QUIT,     TYPE_ONEBYTE, BASIC_TOKEN_QUIT,       TRUE,   FALSE}, /* 178 */
+  {"RENUMBER",  8, 3, TYPE_COMMAND,     BASIC_TOKEN_RENUMBER, TYPE_COMMAND, BASIC_TOKEN_RENUMBER,   FALSE,  FALSE}, /* 179 */
   {"RUN",       3, 2, TYPE_ONEBYTE,     BASIC_TOKEN_RUN,      TYPE_ONEBYTE, BASIC_TOKEN_RUN,        TRUE,   FALSE},
-  {"SAVEO",     5, 5, TYPE_COMMAND,     BASIC_TOKEN_SAVEO,    TYPE_COMMAND, BASIC_TOKEN_SAVEO,      FALSE,  FALSE}, /* 175 */
+  {"SAVEO",     5, 5, TYPE_COMMAND,     BASIC_TOKEN_SAVEO,    TYPE_COMMAND, BASIC_TOKEN_SAVEO,      FALSE,  FALSE}, /* 181 */
   {"SAVE",      4, 2, TYPE_COMMAND,     BASIC_TOKEN_SAVE,     TYPE_COMMAND, BASIC_TOKEN_SAVE,       FALSE,  FALSE},
-  {"TEXTLOAD",  8, 3, TYPE_COMMAND,     BASIC_TOKEN_TEXTLOAD, TYPE_COMMAND, BASIC_TOKEN_TEXTLOAD,   FALSE,  FALSE}, /* 177 */
+  {"TEXTLOAD",  8, 3, TYPE_COMMAND,     BASIC_TOKEN_TEXTLOAD, TYPE_COMMAND, BASIC_TOKEN_TEXTLOAD,   FALSE,  FALSE}, /* 183 */
   {"TEXTSAVEO", 9, 9, TYPE_COMMAND,     BASIC_TOKEN_TEXTSAVEO, TYPE_COMMAND, BASIC_TOKEN_TEXTSAVEO, FALSE,  FALSE},
   {"TEXTSAVE",  8, 5, TYPE_COMMAND,     BASIC_TOKEN_TEXTSAVE, TYPE_COMMAND, BASIC_TOKEN_TEXTSAVE,   FALSE,  FALSE},
   {"TWINO",     5, 2, TYPE_COMMAND,     BASIC_TOKEN_TWINO,    TYPE_COMMAND, BASIC_TOKEN_TWINO,      TRUE,   FALSE},
   {"TWIN",      4, 4, TYPE_COMMAND,     BASIC_TOKEN_TWIN,     TYPE_COMMAND, BASIC_TOKEN_TWIN,       TRUE,   FALSE},
-  {"ZZ",        1, 1, 0, 0, 0, 0, FALSE, FALSE}                                                         /* 182 */
+  {"ZZ",        1, 1, 0, 0, 0, 0, FALSE, FALSE}                                                         /* 188 */
 };
 
 #define TOKTABSIZE (sizeof(tokens)/sizeof(token))
 
 static int start_letter [] = {
-  0, 9, 13, 26, 33, 49, 54, 59, 60, NOKEYWORD, NOKEYWORD, 66, 75, 81, 83, 94,
-  105, 106, 118, 131, 141, 143, 149, 153, NOKEYWORD, NOKEYWORD
+  0, 9, 13, 26, 34, 50, 55, 60, 61, NOKEYWORD, NOKEYWORD, 67, 76, 85, 87, 98,
+  109, 110, 122, 136, 146, 148, 155, 159, NOKEYWORD, NOKEYWORD
 };
 
 static int command_start [] = { /* Starting positions for commands in 'tokens' */
-  154, NOKEYWORD, 156, 157, 158, NOKEYWORD, NOKEYWORD, 160, 161, NOKEYWORD,
-  NOKEYWORD, 162, NOKEYWORD, 170, 171, NOKEYWORD, 172, 173, 175, 177,
+  160, NOKEYWORD, 162, 163, 164, NOKEYWORD, NOKEYWORD, 166, 167, NOKEYWORD,
+  NOKEYWORD, 168, NOKEYWORD, 176, 177, NOKEYWORD, 178, 179, 181, 183,
   NOKEYWORD, NOKEYWORD, NOKEYWORD, NOKEYWORD, NOKEYWORD, NOKEYWORD
 };
 
@@ -1593,7 +1599,8 @@ static char *functionlist [] = {        /* Functions -> function name */
   "INT", "LEN", "LISTO", "LN", "LOG", "OPENIN","OPENOUT", "OPENUP",             /* 28..2F */
   "PI", "POINT(", "POS", "RAD", "REPORT$", "RETCODE", "RND", "SGN",             /* 30..37 */
   "SIN", "SQR", "STR$", "STRING$(", "SUM", "TAN", "TEMPO", "USR",               /* 38..3F */
-  "VAL", "VERIFY(", "VPOS", "XLATE$("                                                   /* 40..44 */
+  "VAL", "VERIFY(", "VPOS", "XLATE$(", "SPLIT(", "DOT(", "MAX(", "MEAN(",       /* 40..47 */
+  "MIN(", "VARIANCE("                                                           /* 48..49 */
 };
 
 static char *printlist [] = {NIL, "SPC", "TAB("};
@@ -1603,18 +1610,38 @@ static char *printlist [] = {NIL, "SPC", "TAB("};
 ** form. The function returns the length of the expanded form
 */
 static int expand_token(char *cp, char *namelist[], byte token) {
-  int n, count;
-  char *name;
+  char *name, *start;
   name = namelist[token];
   if (name == NIL) error(ERR_BROKEN, __LINE__, "tokens");       /* Sanity check for bad token value */
-  strcpy(cp, name);
-  count = strlen(name);
+  start = cp;
   if (basicvars.list_flags.lower) {     /* Lower case version of name required */
-    for (n=0; n<count; n++) {
-      *cp = tolower(*cp);
-      cp++;
-    }
+    while (*name != asc_NUL) *cp++ = tolower(*name++);
+  }
+  else {
+    while (*name != asc_NUL) *cp++ = *name++;
   }
+  return cp-start;
+}
+
+/*
+** 'expand_number' stores the decimal form of the non-negative number
+** 'value' at 'cp', padded on the left with blanks to 'width' characters.
+** It returns the number of characters stored
+*/
+static int expand_number(char *cp, int32 value, int width) {
+  char digits[12];
+  int n, count;
+  n = 0;
+  do {
+    digits[n++] = '0'+value%10;
+    value = value/10;
+  } while (value>0);
+  count = 0;
+  while (width>n) {
+    cp[count++] = ' ';
+    width--;
+  }
+  while (n>0) cp[count++] = digits[--n];
   return count;
 }
 
@@ -1630,15 +1657,16 @@ static byte *skip_source(byte *p) {
 /*
 ** 'expand' takes the tokenised line passed to it and expands it to its
 ** original form in the buffer provided. 'line' points at the very start of
-** the tokenised line
+** the tokenised line. The function returns the length of the expanded line
 */
-void expand(byte *line, char *text) {
+int32 expand(byte *line, char *text) {
   byte token;
   byte *lp;
+  char *start;
   int n, count, thisindent, nextindent;
+  start = text;
   if (!basicvars.list_flags.noline) {   /* Include line number */
-    sprintf(text, "%5d", get_lineno(line));
-    text+=5;
+    text+=expand_number(text, get_lineno(line), 5);
     if (basicvars.list_flags.space) {   /* Need a blank before the expanded line */
       *text = ' ';
       text++;
@@ -1706,8 +1734,7 @@ void expand(byte *line, char *text) {
 /* Deal with special cases first */
     if (token == BASIC_TOKEN_XLINENUM) {      /* Line number */
       lp++;
-      count = sprintf(text, "%d", get_lineno(lp));
-      text+=count;
+      text+=expand_number(text, get_lineno(lp), 0);
       lp+=LINESIZE;
     }
     else if (token == BASIC_TOKEN_XVAR)       /* Marks start of variable name - Ignore */
@@ -1750,7 +1777,7 @@ void expand(byte *line, char *text) {
       case TYPE_FUNCTION:       /* Built-in Function */
         lp++;
         token = *lp;
-        if (token>BASIC_TOKEN_XLATEDOL) error(ERR_BADPROG);
+        if (token>BASIC_TOKEN_VARIANCE) error(ERR_BADPROG);
         count = expand_token(text, functionlist, token);
         break;
       case TYPE_COMMAND:
@@ -1768,12 +1795,103 @@ void expand(byte *line, char *text) {
     token = *lp;
   }
   *text = asc_NUL;
+  return text-start;
 }
 
 void reset_indent(void) {
   indentation = 0;
 }
 
+/*
+** The patch log records where 'set_address' has filled in the address
+** of a variable, procedure, function or case table so that
+** 'clear_varptrs' can put back the original tokens without having to
+** scan the whole of the program and every installed library. Each
+** entry holds the token to restore and the bytes that followed it.
+** Entries are only valid while 'has_offsets' is set: the editor clears
+** the flag after resetting every line itself, so the first address
+** filled in after that starts a new log. 'NEW' and 'OLD' undo the log
+** before the flag is cleared. If the log cannot be extended
+** 'clear_varptrs' falls back to scanning the program
+*/
+typedef struct {
+  byte *patchaddr;		/* Address of the token */
+  byte token;			/* Token to put back */
+  byte patchbytes[LOFFSIZE];	/* Original contents of the offset after the token */
+} patchentry;
+
+#define PATCHLOGSIZE 1024	/* Initial number of entries in the patch log */
+
+static patchentry *patchlog = NIL;
+static int32 patchcount = 0;		/* Number of entries in use */
+static int32 patchsize = 0;		/* Number of entries allocated */
+static boolean patchoverflow = FALSE;	/* TRUE if a patch could not be recorded */
+
+/*
+** 'note_offsets' is called whenever an offset or address is filled in
+** in the tokenised code. If the program did not have any until now
+** then whatever is in the patch log refers to code that has since been
+** reset or replaced so it is discarded
+*/
+static void note_offsets(void) {
+  if (!basicvars.runflags.has_offsets) {
+    patchcount = 0;
+    patchoverflow = FALSE;
+    basicvars.runflags.has_offsets = TRUE;
+  }
+}
+
+/*
+** 'unpatched_token' returns the token that 'clear_varptrs' puts back
+** in place of 'token' or zero if it leaves tokens of that type alone
+*/
+static byte unpatched_token(byte token) {
+  if (token == BASIC_TOKEN_XVAR || token == BASIC_TOKEN_INT64VAR
+   || (token >= BASIC_TOKEN_INTVAR && token <= BASIC_TOKEN_FLOATINDVAR)) return BASIC_TOKEN_XVAR;
+  if (token == BASIC_TOKEN_FNPROCALL || token == BASIC_TOKEN_XFNPROCALL) return BASIC_TOKEN_XFNPROCALL;
+  if (token == BASIC_TOKEN_CASE || token == BASIC_TOKEN_XCASE) return BASIC_TOKEN_XCASE;
+  return 0;
+}
+
+/*
+** 'in_program' returns TRUE if 'tp' points into the program or into
+** one of the installed libraries. Tokens anywhere else, for example in
+** the command line, an 'EVAL' expression or a library loaded by
+** 'LIBRARY', are not reset by 'clear_varptrs'
+*/
+static boolean in_program(byte *tp) {
+  library *lp;
+  if (tp >= basicvars.start && tp < basicvars.top) return TRUE;
+  for (lp = basicvars.installist; lp != NIL; lp = lp->libflink) {
+    if (tp >= lp->libstart && tp < lp->libstart+lp->libsize) return TRUE;
+  }
+  return FALSE;
+}
+
+/*
+** 'log_patch' adds the token at 'tp' to the patch log before its
+** offset is overwritten. 'token' is the value to put back
+*/
+static void log_patch(byte *tp, byte token) {
+  patchentry *pp;
+  if (patchoverflow) return;
+  if (patchcount == patchsize) {
+    int32 newsize = patchsize == 0 ? PATCHLOGSIZE : patchsize*2;
+    pp = realloc(patchlog, newsize*sizeof(patchentry));
+    if (pp == NIL) {
+      patchoverflow = TRUE;
+      return;
+    }
+    patchlog = pp;
+    patchsize = newsize;
+  }
+  pp = &patchlog[patchcount];
+  pp->patchaddr = tp;
+  pp->token = token;
+  memcpy(pp->patchbytes, tp+1, LOFFSIZE);
+  patchcount++;
+}
+
 /*
 ** 'set_dest' stores a branch destination in the tokenised code at 'tp'.
 ** The destination is given as the number of bytes to skip from the address
@@ -1787,7 +1905,7 @@ void set_dest(byte *tp, byte *dest) {
   offset = dest-tp;
   *(tp) = CAST(offset, byte);
   *(tp+1) = CAST(offset>>BYTESHIFT, byte);
-  basicvars.runflags.has_offsets = TRUE;
+  note_offsets();
 }
 
 /*
@@ -1796,10 +1914,16 @@ void set_dest(byte *tp, byte *dest) {
 ** is the address to be stored.
 ** The value stored is the four byte offset of the variable
 ** from the start of the Basic workspace, not its address.
+** References to variables, procedures, functions and case tables in
+** the program or in installed libraries are recorded in the patch log
+** so that 'clear_varptrs' can undo them
 */
 void set_address(byte *tp, void *p) {
   int n, offset;
-  basicvars.runflags.has_offsets = TRUE;
+  byte token;
+  note_offsets();
+  token = unpatched_token(*tp);
+  if (token != 0 && in_program(tp)) log_patch(tp, token);
   offset = CAST(p, byte *)-basicvars.workspace;
   for (n=0; n<LOFFSIZE; n++) {
     tp++;
@@ -1808,6 +1932,23 @@ void set_address(byte *tp, void *p) {
   }
 }
 
+/*
+** 'set_intvalue' overwrites the token at 'tp' with a 32-bit integer
+** constant with the value 'value'. The token being replaced must be
+** followed by at least INTSIZE bytes of data, for example, a string
+** constant. This is used to replace expressions that always give the
+** same result with that result once they have been evaluated
+*/
+void set_intvalue(byte *tp, int32 value) {
+  int n;
+  *tp = BASIC_TOKEN_INTCON;
+  for (n=0; n<INTSIZE; n++) {
+    tp++;
+    *tp = CAST(value, byte);
+    value = value>>BYTESHIFT;
+  }
+}
+
 /*
 ** 'get_srcaddr' returns the address of a byte in the source part
 ** of a line. This is given as an offset from the address of the
@@ -1902,6 +2043,16 @@ void clear_linerefs(byte *bp) {
 void clear_varptrs(void) {
   byte *bp;
   library *lp;
+  if (!basicvars.runflags.has_offsets) return;	/* Nothing has been filled in */
+  if (!patchoverflow) {	/* Undo the entries in the patch log, latest first */
+    while (patchcount > 0) {
+      patchcount--;
+      bp = patchlog[patchcount].patchaddr;
+      *bp = patchlog[patchcount].token;
+      memcpy(bp+1, patchlog[patchcount].patchbytes, LOFFSIZE);
+    }
+    return;
+  }
   bp = basicvars.start;
   while (!AT_PROGEND(bp)) {
     clear_varaddrs(bp);
@@ -1916,6 +2067,8 @@ void clear_varptrs(void) {
     }
     lp = lp->libflink;
   }
+  patchcount = 0;
+  patchoverflow = FALSE;
 }
 
 
@@ -1959,7 +2112,7 @@ boolean isvalid(byte *bp) {
         if (cp[1] == 0 || cp[1] > BASIC_TOKEN_TAB) return FALSE;
         break;
      case TYPE_FUNCTION:
-        if (cp[1] == 0 || (cp[1] > BASIC_TOKEN_TIMEDOL && cp[1] < BASIC_TOKEN_ABS) || cp[1] > BASIC_TOKEN_VPOS) return FALSE;
+        if (cp[1] == 0 || (cp[1] > BASIC_TOKEN_TIMEDOL && cp[1] < BASIC_TOKEN_ABS) || cp[1] > BASIC_TOKEN_VARIANCE) return FALSE;
         break;
       case TYPE_COMMAND:
         if (cp[1] == 0 || cp[1] > BASIC_TOKEN_TWINO) return FALSE;
@@ -1974,61 +2127,52 @@ boolean isvalid(byte *bp) {
 }
 
 /*
-** 'resolve_linenums' goes through a line and resolves all line number
-** references. It replaces line number references with pointers to the
-** *start* of the wanted line
-*/
-void resolve_linenums(byte *bp) {
-  byte *dest;
-  int32 line;
-  bp = FIND_EXEC(bp);
-  while (*bp != asc_NUL) {
-    if (*bp == BASIC_TOKEN_XLINENUM) {        /* Unresolved reference */
-      line = get_linenum(bp);
-      dest = find_line(line);
-      if (line == get_lineno(dest)) {   /* Found line number */
-        set_address(bp, dest);
-        *bp = BASIC_TOKEN_LINENUM;
-      }
-    }
-    else if (*bp == BASIC_TOKEN_LINENUM) {    /* Resolved reference - Replace with ref to start of line */
-      dest = get_address(bp);
-      set_address(bp, find_linestart(dest));
-    }
-    bp = skip_token(bp);
-  }
-}
-
-/*
-** 'reset_linenums' goes through a line and changes any line numbers
-** referenced to their new values. As a bonus, it leaves all the
+** 'renumber_linerefs' goes through a line and changes any line numbers
+** referenced to their new values when the program is renumbered.
+** 'lines' holds the address of each of the 'count' lines of the program
+** in order and line 'n' is being given the number start+n*step.
+** 'linemap' maps an old line number up to 'highline' to the index of that
+** line in 'lines' or is -1 if there is no such line. References that have already been
+** resolved are found by address instead. As a bonus, it leaves all the
 ** line number pointers set to their correct values
-** FIX code does not work after token changes
 */
-void reset_linenums(byte *bp) {
+void renumber_linerefs(byte *bp, byte *lines[], int32 count, int32 linemap[], int32 highline, int32 start, int32 step) {
   byte *dest, *sp;
-  int32 line;
+  int32 line, low, high, mid;
   sp = bp+OFFSOURCE;
   bp = FIND_EXEC(bp);
   while (*bp != asc_NUL) {
     if (*bp == BASIC_TOKEN_LINENUM || *bp == BASIC_TOKEN_XLINENUM) {        /* Find corresponding ref in source */
       while (*sp != BASIC_TOKEN_XLINENUM && *sp != asc_NUL) sp++;
       if (*sp == asc_NUL) error(ERR_BROKEN, __LINE__, "tokens");            /* Sanity check */
-    }
-    if (*bp == BASIC_TOKEN_LINENUM) { /* Line number reference that has to be updated */
-      dest = get_address(bp);
-      line = get_lineno(dest);  /* Fetch the new line number */
+      if (*bp == BASIC_TOKEN_LINENUM) { /* Resolved reference - Find the line it points into */
+        dest = get_address(bp);
+        low = 0;
+        high = count-1;
+        while (low<high) {
+          mid = (low+high+1)/2;
+          if (lines[mid]<=dest) low = mid; else high = mid-1;
+        }
+        mid = low;
+      }
+      else {
+        line = get_linenum(bp);
+        mid = (line>=0 && line<=highline) ? linemap[line] : -1;
+      }
+      if (mid>=0) {     /* Line number reference that has to be updated */
+        dest = lines[mid];
 /* Update the line number in the source part of the line */
-      set_linenum(sp, line);
-      sp+=1+LINESIZE;   /* Skip the line number in the source */
+        set_linenum(sp, start+mid*step);
 /* Change the address to point at the executable tokens */
-      set_address(bp, FIND_EXEC(dest));
-    }
-    else if (*bp == BASIC_TOKEN_XLINENUM) {   /* Line number missing - Issue a warning */
-      byte *savedcurr = basicvars.current;
-      basicvars.current = bp;   /* Ensure error message shows the line number of the bad line */
-      error(WARN_LINEMISS, get_linenum(bp));
-      basicvars.current = savedcurr;
+        set_address(bp, FIND_EXEC(dest));
+        *bp = BASIC_TOKEN_LINENUM;
+      }
+      else {    /* Line number missing - Issue a warning */
+        byte *savedcurr = basicvars.current;
+        basicvars.current = bp;   /* Ensure error message shows the line number of the bad line */
+        error(WARN_LINEMISS, get_linenum(bp));
+        basicvars.current = savedcurr;
+      }
       sp+=1+LINESIZE;   /* Skip the line number in the source */
     }
     bp = skip_token(bp);
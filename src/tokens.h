@@ -343,6 +343,12 @@
 #define BASIC_TOKEN_VERIFY	0x41u
 #define BASIC_TOKEN_VPOS	0x42u
 #define BASIC_TOKEN_XLATEDOL	0x43u
+#define BASIC_TOKEN_SPLIT	0x44u
+#define BASIC_TOKEN_DOT		0x45u
+#define BASIC_TOKEN_MAX		0x46u
+#define BASIC_TOKEN_MEAN	0x47u
+#define BASIC_TOKEN_MIN		0x48u
+#define BASIC_TOKEN_VARIANCE	0x49u
 
 /*
 ** Print functions preceded with 0xFE
@@ -354,11 +360,12 @@
 extern byte thisline[];			/* tokenised version of command line */
 
 extern void tokenize(char *, byte [], boolean, boolean);
-extern void expand(byte *, char *);
+extern int32 expand(byte *, char *);
 extern byte *skip_token(byte *);
 extern byte *skip_name(byte *);
 extern void set_dest(byte *, byte *);
 extern void set_address(byte *, void *);
+extern void set_intvalue(byte *, int32);
 extern byte *get_srcaddr(byte *);
 extern void save_lineno(byte *, int32);
 extern int32 get_lineno(byte *);	/* Returns line number at start of line */
@@ -369,8 +376,7 @@ extern void clear_varptrs(void);
 extern void clear_linerefs(byte *);
 extern boolean isvalid(byte *);
 extern void reset_indent(void);
-extern void resolve_linenums(byte *);
-extern void reset_linenums(byte *);
+extern void renumber_linerefs(byte *, byte *[], int32, int32 [], int32, int32, int32);
 extern int32 reformat(byte *, byte *, int32);
 extern boolean isempty(byte []);
 
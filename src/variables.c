@@ -35,22 +35,61 @@
 #include "evaluate.h"
 #include "tokens.h"
 #include "stack.h"
+#include "strings.h"
 #include "heap.h"
 #include "errors.h"
 #include "miscprocs.h"
 #include "screen.h"
 #include "lvalue.h"
 
+#if defined(TARGET_UNIX) | defined(TARGET_MACOSX) | defined(TARGET_GNU)
+#define USE_MAPPEDARRAYS
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 #define FIELDWIDTH 20		/* Width of field used to print each variable's value */
 #define PRINTWIDTH 80		/* Default maximum number of characters printed per line */
 #define MAXSUBSTR 45		/* Maximum characters printed from string */
 
 #define VARMASK (VARLISTS-1)	/* Mask for selecting hash list */
 
+#define LIBINDEXSIZE 1024	/* Number of hash chains in each library PROC/FN index */
+#define LIBINDEXMASK (LIBINDEXSIZE-1)	/* Mask for selecting index hash chain */
+
 /* #define DEBUG */
 
 char *nullstring = "";		/* Null string used when defining string variables */
 
+#ifdef USE_MAPPEDARRAYS
+/*
+** 'mappedarray' records the details of a file mapped into memory by
+** 'DIM <array>(...) OPENIN/OPENUP <file>' so that the mapping can be
+** removed when the variables are discarded. The list is kept outside
+** of the Basic heap as the heap is reset independently of it
+*/
+typedef struct mappedarray {
+  struct mappedarray *mapflink;	/* Next mapping in list */
+  void *mapaddr;		/* Address of mapping */
+  size_t mapsize;		/* Size of mapping in bytes */
+} mappedarray;
+
+static mappedarray *maplist = NIL;	/* List of arrays mapped on to files */
+#endif
+
+/*
+** The procedures and functions in libraries are found using two hash
+** indexes, one covering the libraries loaded with LIBRARY and one for
+** those loaded with INSTALL. The first is kept on the Basic heap and
+** is discarded along with those libraries. The second lives as long
+** as the installed libraries do
+*/
+static libfnproc **libindex = NIL;	/* Index of PROCs and FNs in LIBRARY libraries */
+static libfnproc **installindex = NIL;	/* Index of PROCs and FNs in INSTALLed libraries */
+
 
 /*
 ** 'hash' returns a hash value for the variable name passed to it
@@ -78,10 +117,19 @@ void clear_varlists(void) {
   basicvars.runflags.has_variables = FALSE;
   basicvars.lastsearch = basicvars.start;
   basicvars.liblist = NIL;
-/* Now clear the PROC/FN lists and symbol tables for installed libraries */
+  libindex = NIL;
+#ifdef USE_MAPPEDARRAYS
+  while (maplist!=NIL) {	/* Unmap any file-backed arrays */
+    mappedarray *mp = maplist;
+    maplist = mp->mapflink;
+    munmap(mp->mapaddr, mp->mapsize);
+    free(mp);
+  }
+#endif
+/* Now clear the symbol tables for installed libraries */
   lp = basicvars.installist;
   while (lp!=NIL) {
-    lp->libfplist = NIL;
+    lp->libscanned = FALSE;
     for (n=0; n<VARLISTS; n++) lp->varlists[n] = NIL;
     lp = lp->libflink;
   }
@@ -350,6 +398,79 @@ void list_libraries(char ch) {
   }
 }
 
+/*
+** 'map_array' handles the 'OPENIN <file>' or 'OPENUP <file>' that can
+** follow the dimensions of a numeric array in a DIM statement. Instead of
+** taking the memory for the array from the heap, the file is mapped into
+** memory and the array's contents live in the file. 'OPENUP' creates a
+** shared mapping: the file is created or extended if need be and any
+** changes made to the array are written back to it. 'OPENIN' creates a
+** private mapping of an existing file: the array can be altered but the
+** changes are not written to the file. 'size' is the size of the array in
+** bytes. The function returns the address of the mapping.
+** On entry, basicvars.current points at the OPENIN or OPENUP token
+*/
+static void *map_array(variable *vp, size_t size) {
+#ifdef USE_MAPPEDARRAYS
+  boolean shared;
+  stackitem stringtype;
+  basicstring descriptor;
+  char filename[FNAMESIZE];
+  struct stat filestat;
+  mappedarray *mp;
+  void *base;
+  int fd;
+
+  shared = *(basicvars.current+1) == BASIC_TOKEN_OPENUP;
+  basicvars.current+=2;		/* Skip two-byte OPENIN/OPENUP token */
+  expression();
+  stringtype = GET_TOPITEM;
+  if (stringtype != STACK_STRING && stringtype != STACK_STRTEMP) error(ERR_TYPESTR);
+  descriptor = pop_string();
+  if (descriptor.stringlen == 0) error(ERR_FILENAME);
+  if (descriptor.stringlen >= FNAMESIZE) descriptor.stringlen = FNAMESIZE-1;
+  memmove(filename, descriptor.stringaddr, descriptor.stringlen);
+  filename[descriptor.stringlen] = asc_NUL;
+  if (stringtype == STACK_STRTEMP) free_string(descriptor);
+  if (shared)
+    fd = open(filename, O_RDWR | O_CREAT, 0666);
+  else {
+    fd = open(filename, O_RDONLY);
+  }
+  if (fd == -1) error(shared ? ERR_OPENWRITE : ERR_NOTFOUND, filename);
+  if (fstat(fd, &filestat) == -1) {
+    close(fd);
+    error(ERR_READFAIL, filename);
+  }
+  if (filestat.st_size < size) {	/* File is smaller than the array */
+    if (!shared) {
+      close(fd);
+      error(ERR_HITEOF);
+    }
+    if (ftruncate(fd, size) == -1) {	/* Extend file. New part reads as zeroes */
+      close(fd);
+      error(ERR_WRITEFAIL, filename);
+    }
+  }
+  base = mmap(NULL, size, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) error(ERR_BADDIM, vp->varname);
+  mp = malloc(sizeof(mappedarray));
+  if (mp == NIL) {
+    munmap(base, size);
+    error(ERR_BADDIM, vp->varname);
+  }
+  mp->mapaddr = base;
+  mp->mapsize = size;
+  mp->mapflink = maplist;
+  maplist = mp;
+  return base;
+#else
+  error(ERR_SYNTAX);	/* File-backed arrays are not available on this platform */
+  return NIL;
+#endif
+}
+
 /*
 ** 'define_array' is called to collect the dimensions of an array
 ** and to create the array. 'vp' points at the symbol table entry
@@ -359,6 +480,7 @@ void list_libraries(char ch) {
 void define_array(variable *vp, boolean islocal) {
   int32 bounds[MAXDIMS];
   int32 n, dimcount, highindex, elemsize = 0, size;
+  boolean ismapped;
   basicarray *ap;
 
 #ifdef DEBUG
@@ -386,9 +508,11 @@ void define_array(variable *vp, boolean islocal) {
     highindex = eval_integer();
     if (*basicvars.current!=',' && *basicvars.current!=')' && *basicvars.current!=']') error(ERR_CORPNEXT);
     if (highindex<0) error(ERR_NEGDIM, vp->varname);
+    if (highindex==MAXINTVAL) error(ERR_BADDIM, vp->varname);
     highindex++;	/* Add 1 to get size of dimension */
     if (dimcount>MAXDIMS) error(ERR_DIMCOUNT, vp->varname);	/* Array has too many dimemsions */
     bounds[dimcount] = highindex;
+    if (size>MAXINTVAL/highindex) error(ERR_BADDIM, vp->varname);	/* Number of elements will not fit in 32 bits */
     size = size*highindex;
     dimcount++;
     if (*basicvars.current!=',') break;
@@ -397,8 +521,21 @@ void define_array(variable *vp, boolean islocal) {
   if (*basicvars.current!=')' && *basicvars.current!=']') error(ERR_RPMISS);
   if (dimcount==0) error(ERR_SYNTAX);	/* No array dimemsions supplied */
   basicvars.current++;	/* Skip the ')' */
+  ismapped = *basicvars.current == TYPE_FUNCTION
+   && (*(basicvars.current+1) == BASIC_TOKEN_OPENIN || *(basicvars.current+1) == BASIC_TOKEN_OPENUP);
+  if (!ismapped && size>MAXINTVAL/elemsize) error(ERR_BADDIM, vp->varname);	/* Array is too large for the heap or stack */
 /* Now create the array and initialise it */
-  if (islocal) {	/* Acquire memory from stack for a local array */
+  if (ismapped) {	/* Array contents are held in a file mapped into memory */
+    void *base;
+    if (vp->varflags == VAR_STRARRAY) error(ERR_NUMARRAY);
+    if (islocal) error(ERR_SYNTAX);
+/* Map the file first so that nothing is left allocated if that fails */
+    base = map_array(vp, (size_t)size*elemsize);
+    ap = condalloc(sizeof(basicarray));		/* Grab memory for array descriptor */
+    if (ap==NIL) error(ERR_BADDIM, vp->varname);	/* The mapping is released along with the other arrays */
+    ap->arraystart.arraybase = base;
+  }
+  else if (islocal) {	/* Acquire memory from stack for a local array */
     ap = alloc_stackmem(sizeof(basicarray));	/* Grab memory for array descriptor */
     if (ap==NIL) error(ERR_BADDIM, vp->varname);
     if (vp->varflags==VAR_STRARRAY)	/* Grab memory for array and mark it as string array */
@@ -417,8 +554,13 @@ void define_array(variable *vp, boolean islocal) {
   ap->arrsize = size;
   for (n=0; n<dimcount; n++) ap->dimsize[n] = bounds[n];
   vp->varentry.vararray = ap;
-/* Now zeroise all the array elememts */
-  if (vp->varflags==VAR_INTARRAY)
+/* Now zeroise all the array elememts. File-backed arrays keep their contents */
+  if (ismapped) {
+#ifdef DEBUG
+    if (basicvars.debug_flags.variables) fprintf(stderr, "Array %s) mapped at %p, %d elements\n", vp->varname, ap->arraystart.arraybase, size);
+#endif
+  }
+  else if (vp->varflags==VAR_INTARRAY)
     for (n=0; n<size; n++) ap->arraystart.intbase[n] = 0;
   else if (vp->varflags==VAR_INT64ARRAY)
     for (n=0; n<size; n++) ap->arraystart.int64base[n] = 0;
@@ -618,6 +760,7 @@ static void scan_parmlist(variable *vp) {
   dp->parmcount = count;
   dp->simple = count==1 && formlist->parameter.typeinfo==VAR_INTWORD;
   dp->parmlist = formlist;
+  dp->localist = NIL;
   vp->varentry.varfnproc = dp;
   if (what==BASIC_TOKEN_PROC)
     vp->varflags = VAR_PROC;
@@ -705,64 +848,93 @@ static void add_libarray(byte *tp, library *lp) {
 }
 
 /*
-** 'add_procfn' creates an entry for a procedure or function
-** in a library and returns a pointer to its entry. 'tp' points
-** at the 'DEF' token when the function is called
+** 'clear_libindex' discards the index of procedures and functions in
+** libraries loaded via LIBRARY. The memory it occupies is reclaimed
+** when the Basic heap is cleared
 */
-static libfnproc *add_procfn(byte *bp, byte *tp) {
-  byte *ep, *base;
-  libfnproc *fpp;
-  int namelen;
+void clear_libindex(void) {
+  libindex = NIL;
+}
+
+/*
+** 'index_library' adds the procedures and functions in library 'lp' to
+** the LIBRARY or INSTALL index, depending on 'onheap'. Libraries loaded
+** later are searched first, so the new entries go on the front of the
+** hash chains. If a library defines a PROC or FN more than once, only
+** the first definition is added, as a search of the library would only
+** ever find that one
+*/
+void index_library(library *lp, boolean onheap) {
+  byte *bp, *tp, *base, *ep;
+  libfnproc **index, *fpp, *dup;
+  int32 hashvalue, namelen;
   char pfname[MAXNAMELEN];
-  base = get_srcaddr(tp+1);	/* Find address of PROC/FN name */
-  ep = skip_name(base);	/* Find byte after name */
-  if (*(ep-1)=='(') ep--;	/* '(' here is not part of the name but the start of the parameter list */
-  namelen = ep-base;
-  memmove(pfname, base, namelen);
-  pfname[namelen] = asc_NUL;
-  fpp = allocmem(sizeof(libfnproc));
-  fpp->fpline = bp;
-  fpp->fpname = base;
-  fpp->fpmarker = tp+1;	/* Need pointer to the XFNPROCALL token for scan_parmlist() */
-  fpp->fphash = hash(pfname);
-  fpp->fpflink = NIL;
-  return fpp;
+  index = onheap ? libindex : installindex;
+  if (index==NIL) {	/* Create index */
+    if (onheap)
+      index = allocmem(LIBINDEXSIZE*sizeof(libfnproc *));
+    else {
+      index = malloc(LIBINDEXSIZE*sizeof(libfnproc *));
+      if (index==NIL) error(ERR_LIBSIZE, lp->libname);
+    }
+    memset(index, 0, LIBINDEXSIZE*sizeof(libfnproc *));
+    if (onheap) libindex = index; else installindex = index;
+  }
+  bp = lp->libstart;
+  while (!AT_PROGEND(bp)) {
+    tp = FIND_EXEC(bp);
+    if (*tp==BASIC_TOKEN_DEF && *(tp+1)==BASIC_TOKEN_XFNPROCALL) {	/* Found DEF PROC or DEF FN */
+      base = get_srcaddr(tp+1);	/* Find address of PROC/FN name */
+      ep = skip_name(base);	/* Find byte after name */
+      if (*(ep-1)=='(') ep--;	/* '(' here is not part of the name but the start of the parameter list */
+      namelen = ep-base;
+      memmove(pfname, base, namelen);
+      pfname[namelen] = asc_NUL;
+      hashvalue = hash(pfname);
+/* Check for an earlier definition in this library. These are at the front of the chain */
+      dup = index[hashvalue & LIBINDEXMASK];
+      while (dup!=NIL && dup->fplib==lp
+       && (dup->fphash!=hashvalue || dup->fpnamelen!=namelen || memcmp(dup->fpname, base, namelen)!=0)) dup = dup->fpflink;
+      if (dup==NIL || dup->fplib!=lp) {
+        if (onheap)
+          fpp = allocmem(sizeof(libfnproc));
+        else {
+          fpp = malloc(sizeof(libfnproc));
+          if (fpp==NIL) error(ERR_LIBSIZE, lp->libname);
+        }
+        fpp->fplib = lp;
+        fpp->fpline = bp;
+        fpp->fpname = base;
+        fpp->fpnamelen = namelen;
+        fpp->fpmarker = tp+1;	/* Need pointer to the XFNPROCALL token for scan_parmlist() */
+        fpp->fphash = hashvalue;
+        fpp->fpflink = index[hashvalue & LIBINDEXMASK];
+        index[hashvalue & LIBINDEXMASK] = fpp;
+      }
+    }
+    bp+=get_linelen(bp);
+  }
 }
 
 /*
-** 'scan_library' is called to build a list of procedures and
-** functions in a library to speed up library searches. It also
-** looks for 'LIBRARY LOCAL' statements and adds any variables
-** listed on to the library's sumbol table. 'lp' points at the
-** library list entry of interest.
+** 'scan_library' is called to look for 'LIBRARY LOCAL' statements
+** and 'DIM' statements before the first procedure or function in a
+** library and to add any variables listed on to the library's symbol
+** table. 'lp' points at the library list entry of interest.
 ** The function is called the first time a procedure or function
-** is called that is not in the Basic program. As each library
-** is searched for the first time, so this function is invoked.
-** Variables that will be private to the library are created at
-** this time.
+** in the library is called. Variables that will be private to the
+** library are created at this time.
 */
 static void scan_library(library *lp) {
   byte *tp, *bp;
-  libfnproc *fpp, *fpplast;
-  boolean foundproc;
   bp = lp->libstart;
-  fpplast = NIL;
-  foundproc = FALSE;
+  lp->libscanned = TRUE;
   while (!AT_PROGEND(bp)) {
     tp = FIND_EXEC(bp);
-    if (*tp==BASIC_TOKEN_DEF && *(tp+1)==BASIC_TOKEN_XFNPROCALL) {	/* Found DEF PROC or DEF FN */
-      foundproc = TRUE;
-      fpp = add_procfn(bp, tp);
-      if (fpplast==NIL)	/* First PROC or FN found in library */
-        lp->libfplist = fpp;
-      else {
-        fpplast->fpflink = fpp;
-      }
-      fpplast = fpp;
-    }
-    else if (!foundproc && *tp==BASIC_TOKEN_LIBRARY && *(tp+1)==BASIC_TOKEN_LOCAL)	/* LIBRARY LOCAL */
+    if (*tp==BASIC_TOKEN_DEF && *(tp+1)==BASIC_TOKEN_XFNPROCALL) break;	/* Found first DEF PROC or DEF FN */
+    if (*tp==BASIC_TOKEN_LIBRARY && *(tp+1)==BASIC_TOKEN_LOCAL)	/* LIBRARY LOCAL */
       add_libvars(tp, lp);
-    else if (!foundproc && *tp==BASIC_TOKEN_DIM) {
+    else if (*tp==BASIC_TOKEN_DIM) {
       add_libarray(tp, lp);
     }
     bp+=get_linelen(bp);
@@ -770,26 +942,21 @@ static void scan_library(library *lp) {
 }
 
 /*
-** 'search_library' scans a library for procedure or function 'name'. If
-** it finds it, it creates a symbol table entry for the item and returns
-** a pointer to that entry. If the procedure or function cannot be found
-** in this library the function returns NIL.
+** 'search_libindex' looks for procedure or function 'name' in library
+** index 'index'. If it finds it, it creates a symbol table entry for the
+** item and returns a pointer to that entry. If the procedure or function
+** is not in the index the function returns NIL.
 */
-static variable *search_library(library *lp, char *name) {
-  int32 hashvalue;
+static variable *search_libindex(libfnproc **index, char *name, int32 hashvalue) {
   int namelen;
   libfnproc *fpp;
   variable *vp;
-  if (lp->libfplist==NIL) scan_library(lp);	/* Create list of PROCs and FNs in library */
-  hashvalue = hash(name);
+  if (index==NIL) return NIL;
   namelen = strlen(name);
-  fpp = lp->libfplist;
-  if (fpp==NIL) return NIL;		/* Return if library does not contain anything */
-  do {
-    if (fpp->fphash==hashvalue && memcmp(fpp->fpname, name, namelen)==0) break;	/* Found it */
-    fpp = fpp->fpflink;
-  } while (fpp!=NIL);
-  if (fpp==NIL) return NIL;		/* Entry not found in library */
+  fpp = index[hashvalue & LIBINDEXMASK];
+  while (fpp!=NIL && (fpp->fphash!=hashvalue || fpp->fpnamelen!=namelen || memcmp(fpp->fpname, name, namelen)!=0)) fpp = fpp->fpflink;
+  if (fpp==NIL) return NIL;		/* Entry not found in index */
+  if (!fpp->fplib->libscanned) scan_library(fpp->fplib);	/* Create library's private variables */
   vp = allocmem(sizeof(variable));	/* Entry found. Create symbol table entry for it */
   vp->varname = allocmem(namelen+1);	/* +1 for NUL at end of name */
   strcpy(vp->varname, name);
@@ -801,7 +968,7 @@ static variable *search_library(library *lp, char *name) {
   scan_parmlist(vp);			/* Deal with parameter list */
 #ifdef DEBUG
   if (basicvars.debug_flags.variables) fprintf(stderr, "Created PROC/FN '%s%s' in library '%s' at %p\n",
-   (*CAST(name, byte *)==BASIC_TOKEN_PROC ? "PROC" : "FN"), name+1, lp->libname, vp);
+   (*CAST(name, byte *)==BASIC_TOKEN_PROC ? "PROC" : "FN"), name+1, fpp->fplib->libname, vp);
 #endif
   return vp;
 }
@@ -851,7 +1018,6 @@ static variable *scan_fnproc(char *name) {
   byte *tp, *bp;
   int32 namehash;
   variable *vp;
-  library *lp;
   namehash = hash(name);
   bp = basicvars.lastsearch;	/* Start new search where last one ended */
   vp = NIL;
@@ -865,22 +1031,8 @@ static variable *scan_fnproc(char *name) {
     }
   }
   basicvars.lastsearch = bp;
-  if (vp==NIL && basicvars.liblist!=NIL) {	/* Check the library list for the PROC/FN */
-    lp = basicvars.liblist;
-    do {
-      vp = search_library(lp, name);
-      if (vp!=NIL) break;
-      lp = lp->libflink;
-    } while (lp!=NIL);
-  }
-  if (vp==NIL && basicvars.installist!=NIL) {	/* Check the installed library list */
-    lp = basicvars.installist;
-    do {
-      vp = search_library(lp, name);
-      if (vp!=NIL) break;
-      lp = lp->libflink;
-    } while (lp!=NIL);
-  }
+  if (vp==NIL) vp = search_libindex(libindex, name, namehash);	/* Check the LIBRARY libraries for the PROC/FN */
+  if (vp==NIL) vp = search_libindex(installindex, name, namehash);	/* Check the installed libraries */
   if (vp==NIL) {	/* Procedure/function not found */
     if (*CAST(name, byte *)==BASIC_TOKEN_PROC)	/* First byte of name is a 'PROC' or 'FN' token */
       error(ERR_PROCMISS, name+1);
@@ -917,6 +1069,92 @@ variable *find_fnproc(byte *np, int namelen) {
   return vp;
 }
 
+/*
+** 'mark_allfnprocs' adds symbol table entries for all of the procedures
+** and functions in the program that 'scan_fnproc' has not reached yet.
+** Otherwise a later search could add an entry for the program's own
+** definition in front of one that has been replaced
+*/
+static void mark_allfnprocs(void) {
+  byte *tp, *bp;
+  bp = basicvars.lastsearch;
+  while (!AT_PROGEND(bp)) {
+    tp = FIND_EXEC(bp);
+    if (*tp==BASIC_TOKEN_DEF && *(tp+1)==BASIC_TOKEN_XFNPROCALL) mark_procfn(tp+1);
+    bp+=get_linelen(bp);
+  }
+  basicvars.lastsearch = bp;
+}
+
+/*
+** 'replace_fnprocs' makes the procedures and functions defined in library
+** 'lp' replace any existing ones of the same name, in the program or
+** in other libraries, whilst the program is running. Calls to a
+** procedure or function refer to its symbol table entry rather than
+** to its definition so it is only necessary to point the entry at
+** the new definition. Calls that are in progress carry on running the
+** old code.
+** The work is done in two passes. The first one builds a complete
+** symbol table entry for each procedure and function in the library,
+** taking only the first definition of a name as that is the one a
+** search of the library would find. Nothing has been changed if one
+** of the parameter lists contains an error. The second pass copies the
+** new entries over all the existing ones with the same name, or adds
+** them to the symbol table if there are none. The function returns the
+** number of procedures and functions the library supplies
+*/
+int32 replace_fnprocs(library *lp) {
+  byte *bp, *tp, *base, *ep;
+  variable *defs, *vp;
+  int32 hashvalue, namelen, count, n;
+  boolean found;
+  mark_allfnprocs();
+  if (!lp->libscanned) scan_library(lp);	/* Create library's private variables */
+  count = 0;
+  for (bp = lp->libstart; !AT_PROGEND(bp); bp+=get_linelen(bp)) {
+    tp = FIND_EXEC(bp);
+    if (*tp==BASIC_TOKEN_DEF && *(tp+1)==BASIC_TOKEN_XFNPROCALL) count++;
+  }
+  if (count==0) return 0;
+  defs = allocmem(count*sizeof(variable));
+  count = 0;
+  for (bp = lp->libstart; !AT_PROGEND(bp); bp+=get_linelen(bp)) {
+    tp = FIND_EXEC(bp);
+    if (*tp!=BASIC_TOKEN_DEF || *(tp+1)!=BASIC_TOKEN_XFNPROCALL) continue;
+    base = get_srcaddr(tp+1);	/* Find address of PROC/FN name */
+    ep = skip_name(base);
+    if (*(ep-1)=='(') ep--;	/* '(' here is not part of the name but the start of the parameter list */
+    namelen = ep-base;
+    vp = &defs[count];
+    vp->varname = allocmem(namelen+1);
+    memcpy(vp->varname, base, namelen);
+    vp->varname[namelen] = asc_NUL;
+    vp->varhash = hashvalue = hash(vp->varname);
+    for (n=0; n<count && (defs[n].varhash!=hashvalue || strcmp(defs[n].varname, vp->varname)!=0); n++);
+    if (n<count) continue;	/* Later definition of a name already seen - Ignore it */
+    vp->varentry.varmarker = tp+1;
+    scan_parmlist(vp);
+    count++;
+  }
+  for (n=0; n<count; n++) {
+    hashvalue = defs[n].varhash;
+    found = FALSE;
+/* Update every entry for the name, as calls could refer to any of them */
+    for (vp = basicvars.varlists[hashvalue & VARMASK]; vp!=NIL; vp = vp->varflink) {
+      if (vp->varhash!=hashvalue || strcmp(defs[n].varname, vp->varname)!=0) continue;
+      vp->varflags = defs[n].varflags;
+      vp->varentry = defs[n].varentry;
+      found = TRUE;
+    }
+    if (!found) {	/* New procedure or function */
+      defs[n].varflink = basicvars.varlists[hashvalue & VARMASK];
+      basicvars.varlists[hashvalue & VARMASK] = &defs[n];
+    }
+  }
+  basicvars.runflags.has_variables = TRUE;
+  return count;
+}
+
 /*
 ** 'init_staticvars' is called when the interpreter is first started
 ** to set the static variables A% to Z% to their initial values
@@ -30,8 +30,11 @@ extern void clear_varlists(void);
 extern void list_variables(char);
 extern void list_libraries(char);
 extern void detail_library(library *);
+extern void index_library(library *, boolean);
+extern void clear_libindex(void);
 extern variable *find_variable(byte *, int);
 extern variable *find_fnproc(byte *, int);
+extern int32 replace_fnprocs(library *);
 extern variable *create_variable(byte *, int32, library *);
 extern void define_array(variable *, boolean);
 extern void init_staticvars(void);